@@ -0,0 +1,259 @@
+/***********************************************************************
+ *
+ * Cycle count benchmarks for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+#ifdef BENCH
+
+/* Includes ----------------------------------------------------------*/
+#include <stdlib.h>
+#include <util/atomic.h>
+#include "bench.h"
+#include "fmt.h"
+#include "uart.h"
+#include "lcd.h"
+
+/* Variables ---------------------------------------------------------*/
+static volatile uint16_t bench_u16 = 12345;     // Inputs read at run time
+static volatile uint8_t bench_u8 = 200;
+static volatile int16_t bench_tenths = -123;
+static volatile uint8_t bench_bcd = 0x59;
+static volatile uint8_t bench_nibble = 0x0a;
+static char bench_buf[FMT_TENTHS_LEN];          // Output of measured functions
+
+/* Local functions ---------------------------------------------------*/
+static void bench_empty(void)
+{
+}
+
+static void bench_itoa_u16(void)
+{
+    utoa(bench_u16, bench_buf, 10);
+}
+
+static void bench_fmt_u16(void)
+{
+    fmt_u16(bench_buf, sizeof(bench_buf), bench_u16, 0);
+}
+
+static void bench_itoa_u8(void)
+{
+    utoa(bench_u8, bench_buf, 10);
+}
+
+static void bench_fmt_u8(void)
+{
+    fmt_u8(bench_buf, sizeof(bench_buf), bench_u8, 0);
+}
+
+/* Previous conversion of tenths: utoa of whole part, then the decimal */
+static void bench_itoa_tenths(void)
+{
+    int16_t value = bench_tenths;
+    uint16_t abs_value = (value < 0) ? -value : value;
+    char *str = bench_buf;
+
+    if (value < 0)
+    {
+        *str++ = '-';
+    }
+    utoa(abs_value / 10, str, 10);
+    while (*str != '\0')
+    {
+        str++;
+    }
+    *str++ = '.';
+    *str++ = '0' + abs_value % 10;
+    *str = '\0';
+}
+
+static void bench_fmt_tenths(void)
+{
+    fmt_tenths(bench_buf, sizeof(bench_buf), bench_tenths, 0);
+}
+
+/* Previous conversion of RTC register: itoa of each digit */
+static void bench_itoa_bcd(void)
+{
+    uint8_t bcd = bench_bcd;
+
+    itoa(bcd >> 4, &bench_buf[0], 10);
+    itoa(bcd & 0x0f, &bench_buf[1], 10);
+}
+
+static void bench_fmt_bcd(void)
+{
+    fmt_bcd(bench_buf, bench_bcd);
+}
+
+/* Whole line of LCD until the last character is written */
+static void bench_lcd_line(void)
+{
+    lcd_gotoxy(0, 0);
+    lcd_puts("0123456789ABCDEF");
+    lcd_sync();
+}
+
+#if LCD_IO_MODE == LCD_IO_4BIT
+/* Stores of lcd_write_nibble(), each result includes one call with argument */
+#if (LCD_DATA1_PIN == LCD_DATA0_PIN + 1) && (LCD_DATA2_PIN == LCD_DATA0_PIN + 2) && (LCD_DATA3_PIN == LCD_DATA0_PIN + 3)
+static void bench_nibble_masked(void)
+{
+    lcd_bench_nibble_masked(bench_nibble);
+}
+#endif
+
+static void bench_nibble_bits(void)
+{
+    lcd_bench_nibble_bits(bench_nibble);
+}
+#endif
+
+/**********************************************************************
+ * Function: bench_count()
+ * Purpose:  Count Timer/Counter1 periods of function.
+ * Input:    fn Function to be measured
+ *           cs Clock select bits of TCCR1B
+ * Returns:  Number of periods without the call overhead
+ **********************************************************************/
+static uint16_t bench_count(void (*fn)(void), uint8_t cs)
+{
+    void (*volatile empty)(void) = bench_empty;     // Called like fn, not inlined
+    uint16_t count = 0;
+    uint16_t overhead;
+    uint16_t tcnt;
+    uint8_t tccr;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        tccr = TCCR1B;
+        tcnt = TCNT1;
+        TCCR1B = (tccr & ~(_BV(CS12) | _BV(CS11) | _BV(CS10))) | cs;
+
+        TCNT1 = 0;
+        empty();
+        overhead = TCNT1;
+
+        TCNT1 = 0;
+        fn();
+        count = TCNT1 - overhead;
+
+        TCNT1 = tcnt;
+        TCCR1B = tccr;
+    }
+    return count;
+}
+
+/**********************************************************************
+ * Function: bench_print()
+ * Purpose:  Send "name: value unit" via UART.
+ * Input:    name Name of measured function
+ *           value Result
+ *           unit Unit of result
+ * Returns:  none
+ **********************************************************************/
+static void bench_print(const char *name, uint16_t value, const char *unit)
+{
+    char str[FMT_U16_LEN];
+
+    fmt_u16(str, sizeof(str), value, 5);
+    uart_puts(name);
+    uart_puts(str);
+    uart_puts(unit);
+}
+
+/**********************************************************************
+ * Function: bench_report()
+ * Purpose:  Measure function and send "name: cycles" via UART.
+ * Input:    name Name of measured function
+ *           fn Measured function
+ * Returns:  none
+ **********************************************************************/
+static void bench_report(const char *name, void (*fn)(void))
+{
+    bench_print(name, bench_cycles(fn), " cycles\r\n");
+}
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: bench_cycles()
+ * Purpose:  Count CPU cycles of function by Timer/Counter1 at clk/1.
+ * Input:    fn Function to be measured
+ * Returns:  Number of cycles without the call overhead
+ **********************************************************************/
+uint16_t bench_cycles(void (*fn)(void))
+{
+    return bench_count(fn, _BV(CS10));
+}
+
+/**********************************************************************
+ * Function: bench_micros()
+ * Purpose:  Measure time of function by Timer/Counter1 at clk/64.
+ * Input:    fn Function to be measured
+ * Returns:  Time in us, 4 us resolution
+ **********************************************************************/
+uint16_t bench_micros(void (*fn)(void))
+{
+    return bench_count(fn, _BV(CS11) | _BV(CS10)) * 4;
+}
+
+/**********************************************************************
+ * Function: bench_fmt()
+ * Purpose:  Compare fmt library with itoa() and send results via UART.
+ * Returns:  none
+ **********************************************************************/
+void bench_fmt(void)
+{
+    bench_report("utoa u16 12345:    ", bench_itoa_u16);
+    bench_report("fmt_u16 12345:     ", bench_fmt_u16);
+    bench_report("utoa u8 200:       ", bench_itoa_u8);
+    bench_report("fmt_u8 200:        ", bench_fmt_u8);
+    bench_report("utoa tenths -12.3: ", bench_itoa_tenths);
+    bench_report("fmt_tenths -12.3:  ", bench_fmt_tenths);
+    bench_report("itoa BCD 59:       ", bench_itoa_bcd);
+    bench_report("fmt_bcd 59:        ", bench_fmt_bcd);
+}
+
+/**********************************************************************
+ * Function: bench_lcd()
+ * Purpose:  Measure writing of one nibble to the data pins by a masked
+ *           store and bit by bit, then writing of one LCD line with
+ *           delays and, if RW is connected, with busy flag, and send
+ *           results via UART.
+ * Returns:  none
+ **********************************************************************/
+void bench_lcd(void)
+{
+#if LCD_USE_RW
+    uint8_t used = lcd_busy_flag_used();
+
+    lcd_use_busy_flag(0);
+#endif
+    lcd_sync();
+#if LCD_IO_MODE == LCD_IO_4BIT
+    // Enable stays low, the display ignores the data pins meanwhile
+#if (LCD_DATA1_PIN == LCD_DATA0_PIN + 1) && (LCD_DATA2_PIN == LCD_DATA0_PIN + 2) && (LCD_DATA3_PIN == LCD_DATA0_PIN + 3)
+    bench_report("LCD nibble, masked:  ", bench_nibble_masked);
+#endif
+    bench_report("LCD nibble, bits:    ", bench_nibble_bits);
+#endif
+    bench_print("LCD line, delays:    ", bench_micros(bench_lcd_line), " us\r\n");
+#if LCD_USE_RW
+    lcd_use_busy_flag(1);
+    bench_print("LCD line, busy flag: ", bench_micros(bench_lcd_line), " us\r\n");
+    if (!lcd_busy_flag_used())
+    {
+        uart_puts("Busy flag timed out, delays used\r\n");
+    }
+    else
+    {
+        lcd_use_busy_flag(used);
+    }
+#endif
+}
+
+#endif
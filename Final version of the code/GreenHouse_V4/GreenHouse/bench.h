@@ -0,0 +1,74 @@
+#ifndef BENCH_H
+# define BENCH_H
+
+/***********************************************************************
+ *
+ * Cycle count benchmarks for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/**
+ * @file
+ * @defgroup bench Benchmarks <bench.h>
+ * @code #include "bench.h" @endcode
+ *
+ * @brief Count CPU cycles of functions by Timer/Counter1.
+ *
+ * Compiled only with symbol BENCH defined. During a measurement
+ * Timer/Counter1 runs at the CPU clock for bench_cycles() and at clk/64
+ * for bench_micros(). Its previous setting is restored afterwards, so
+ * benchmarks may run after the scan timer is started. Results are sent
+ * via UART.
+ * @{
+ */
+
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+
+
+/* Function prototypes -----------------------------------------------*/
+/**
+ * @name Functions
+ */
+
+/**
+ * @brief  Count CPU cycles of a function, without the call overhead.
+ * @param  fn Function to be measured, must take less than 65536 cycles
+ * @return Number of cycles
+ * @note   Runs with interrupts disabled.
+ */
+uint16_t bench_cycles(void (*fn)(void));
+
+
+/**
+ * @brief  Measure time of a function, e.g. waiting for a peripheral.
+ * @param  fn Function to be measured, must take less than 65 ms
+ * @return Time in microseconds, 4 us resolution
+ * @note   Runs with interrupts disabled.
+ */
+uint16_t bench_micros(void (*fn)(void));
+
+
+/**
+ * @brief  Compare fmt library with itoa() and send results via UART.
+ * @return none
+ */
+void bench_fmt(void);
+
+
+/**
+ * @brief  Measure writing of one nibble to the LCD data pins by the
+ *         masked store used for consecutive pins and bit by bit, then
+ *         writing of one LCD line with delays and with busy flag, and
+ *         send results via UART. Overwrites the first line.
+ * @return none
+ */
+void bench_lcd(void);
+
+/** @} */
+
+#endif
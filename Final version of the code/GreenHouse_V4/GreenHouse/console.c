@@ -0,0 +1,161 @@
+/***********************************************************************
+ *
+ * Line-oriented UART command console for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/* Includes ----------------------------------------------------------*/
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "console.h"
+#include "uart.h"
+
+/* Variables ---------------------------------------------------------*/
+static const console_cmd_t *console_cmds;   // Table of commands in flash
+static uint8_t console_count = 0;           // Number of commands
+static char console_line[CONSOLE_LINE_LEN]; // Line being received
+static uint8_t console_len = 0;             // Characters in line
+static uint8_t console_overflow = 0;        // Line was too long
+
+/* Local functions ---------------------------------------------------*/
+/**********************************************************************
+ * Function: console_help()
+ * Purpose:  List all commands with their description.
+ * Returns:  none
+ **********************************************************************/
+static void console_help(void)
+{
+    console_cmd_t cmd;
+    uint8_t i;
+
+    for (i = 0; i < console_count; i++)
+    {
+        memcpy_P(&cmd, &console_cmds[i], sizeof(cmd));
+        uart_puts_p(cmd.name);
+        uart_puts(" ");
+        uart_puts_p(cmd.help);
+        uart_puts("\r\n");
+    }
+}
+
+/**********************************************************************
+ * Function: console_execute()
+ * Purpose:  Split line into words and call handler of the command.
+ * Input:    line Terminated command line, modified in place
+ * Returns:  none
+ **********************************************************************/
+static void console_execute(char *line)
+{
+    char *argv[CONSOLE_MAX_ARGS];
+    console_cmd_t cmd;
+    uint8_t argc = 0;
+    uint8_t i;
+
+    while (*line != '\0')
+    {
+        if (*line == ' ')
+        {
+            *line++ = '\0';
+            continue;
+        }
+        if (argc == CONSOLE_MAX_ARGS)
+        {
+            uart_puts_P("Too many arguments\r\n");
+            return;
+        }
+        argv[argc++] = line;
+        while (*line != '\0' && *line != ' ')
+        {
+            line++;
+        }
+    }
+    if (argc == 0)
+    {
+        return;     /* Empty line */
+    }
+
+    if (strcmp_P(argv[0], PSTR("help")) == 0)
+    {
+        console_help();
+        return;
+    }
+    for (i = 0; i < console_count; i++)
+    {
+        memcpy_P(&cmd, &console_cmds[i], sizeof(cmd));
+        if (strcmp_P(argv[0], cmd.name) == 0)
+        {
+            cmd.handler(argc, argv);
+            return;
+        }
+    }
+    uart_puts_P("Unknown command, try help\r\n");
+}
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: console_init()
+ * Purpose:  Set table of commands.
+ * Input:    cmds Table of commands in flash
+ *           count Number of commands
+ * Returns:  none
+ **********************************************************************/
+void console_init(const console_cmd_t *cmds, uint8_t count)
+{
+    console_cmds = cmds;
+    console_count = count;
+    console_len = 0;
+    console_overflow = 0;
+}
+
+/**********************************************************************
+ * Function: console_poll()
+ * Purpose:  Collect received characters, execute line at CR or LF.
+ *           Backspace deletes the last character. Characters received
+ *           with an error and overlong lines are discarded.
+ * Returns:  none
+ **********************************************************************/
+void console_poll(void)
+{
+    unsigned int c;
+
+    while ((c = uart_getc()) != UART_NO_DATA)
+    {
+        if (c & 0xff00)
+        {
+            console_overflow = 1;   /* Frame error or lost characters */
+            continue;
+        }
+        if (c == '\r' || c == '\n')
+        {
+            if (console_overflow)
+            {
+                uart_puts_P("Line discarded\r\n");
+            }
+            else if (console_len != 0)
+            {
+                console_line[console_len] = '\0';
+                console_execute(console_line);
+            }
+            console_len = 0;
+            console_overflow = 0;
+        }
+        else if (c == '\b' || c == 0x7f)
+        {
+            if (console_len != 0)
+            {
+                console_len--;
+            }
+        }
+        else if (console_len < CONSOLE_LINE_LEN - 1)
+        {
+            console_line[console_len++] = c;
+        }
+        else
+        {
+            console_overflow = 1;
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef CONSOLE_H
+# define CONSOLE_H
+
+/***********************************************************************
+ *
+ * Line-oriented UART command console for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/**
+ * @file
+ * @defgroup console UART Console <console.h>
+ * @code #include "console.h" @endcode
+ *
+ * @brief Command line parser fed by the UART receive buffer.
+ *
+ * The UART receive interrupt stores characters in the ringbuffer of
+ * the UART library. console_poll() collects them into a fixed line
+ * buffer and, at CR or LF, splits the line into words separated by
+ * spaces and calls the handler of the command named by the first
+ * word. No memory is allocated dynamically. Call console_poll() from
+ * the main loop, so handlers may wait and do not delay interrupts.
+ *
+ * Command "help" is built in and lists all commands. The table of
+ * commands, their names and help texts are stored in flash.
+ * @{
+ */
+
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+
+
+/* Defines -----------------------------------------------------------*/
+#ifndef CONSOLE_LINE_LEN
+# define CONSOLE_LINE_LEN 32 /**< @brief Longest command line including terminator */
+#endif
+#ifndef CONSOLE_MAX_ARGS
+# define CONSOLE_MAX_ARGS 4 /**< @brief Most words of a command line */
+#endif
+
+/** @brief Command of console, stored in flash */
+typedef struct {
+    const char *name;       /**< @brief First word of command line, in flash */
+    void (*handler)(uint8_t argc, char *argv[]);  /**< @brief Called with all words, argv[0] is name */
+    const char *help;       /**< @brief Arguments and description listed by "help", in flash */
+} console_cmd_t;
+
+
+/* Function prototypes -----------------------------------------------*/
+/**
+ * @name Functions
+ */
+
+/**
+ * @brief  Set table of commands.
+ * @param  cmds Table of commands in flash
+ * @param  count Number of commands in table
+ * @return none
+ * @note   Call after uart_init().
+ */
+void console_init(const console_cmd_t *cmds, uint8_t count);
+
+
+/**
+ * @brief  Process received characters and execute completed lines.
+ * @return none
+ */
+void console_poll(void);
+
+/** @} */
+
+#endif
@@ -0,0 +1,225 @@
+/***********************************************************************
+ *
+ * DHT12 sensor array library for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/* Includes ----------------------------------------------------------*/
+#include <stddef.h>
+#include <util/atomic.h>
+#include "dht12.h"
+
+/* Variables ---------------------------------------------------------*/
+static dht12_t dht12_sensors[DHT12_COUNT];          // Last values of sensors
+static twi_trans_t dht12_trans[DHT12_PIPELINE];     // Transactions in TWI queue
+static uint8_t dht12_data[DHT12_PIPELINE][5];       // Received bytes of transactions
+static uint8_t dht12_index[DHT12_PIPELINE];         // Sensor read by transaction
+static uint8_t dht12_next = DHT12_COUNT;            // Next sensor to be read
+static volatile uint8_t dht12_done = DHT12_COUNT;   // Sensors processed in this scan
+static uint8_t dht12_scans = 0;                     // Scans since absent sensors were read
+
+/* Local functions ---------------------------------------------------*/
+/**********************************************************************
+ * Function: dht12_submit()
+ * Purpose:  Queue reading of the next sensor of the scan.
+ * Input:    slot Index of transaction to be used
+ * Returns:  none
+ **********************************************************************/
+static void dht12_submit(uint8_t slot)
+{
+    twi_trans_t *t = &dht12_trans[slot];
+
+    while (dht12_next < DHT12_COUNT)
+    {
+        uint8_t i = dht12_next++;
+
+        if (dht12_sensors[i].status == TWI_ERR_ADDR_NACK && dht12_scans != 0)
+        {
+            dht12_done++;   /* Absent sensor is skipped */
+            continue;
+        }
+        t->channel = DHT12_CHANNEL(i);
+        if (twi_submit(t) == 0)
+        {
+            dht12_index[slot] = i;
+            dht12_sensors[i].status = TWI_PENDING;
+            return;
+        }
+        dht12_sensors[i].status = DHT12_ERR_BUSY;
+        dht12_done++;
+    }
+}
+
+/**********************************************************************
+ * Function: dht12_callback()
+ * Purpose:  Decode received values and queue the next sensor. Called
+ *           by TWI library when the transaction finishes.
+ * Input:    t Finished transaction
+ * Returns:  none
+ **********************************************************************/
+static void dht12_callback(twi_trans_t *t)
+{
+    uint8_t slot = t - dht12_trans;
+    const uint8_t *d = dht12_data[slot];
+    dht12_t *s = &dht12_sensors[dht12_index[slot]];
+
+    s->status = t->status;
+    if (t->status == TWI_OK)
+    {
+        if ((uint8_t)(d[0] + d[1] + d[2] + d[3]) != d[4])
+        {
+            s->status = DHT12_ERR_CHECKSUM;
+        }
+        else
+        {
+            /* Integer part and tenths, bit 7 of temperature tenths is sign */
+            s->humid = d[0] * 10 + d[1];
+            s->temp = d[2] * 10 + (d[3] & 0x7f);
+            if (d[3] & 0x80)
+            {
+                s->temp = -s->temp;
+            }
+        }
+    }
+    dht12_done++;
+    dht12_submit(slot);
+}
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: dht12_init()
+ * Purpose:  Prepare transactions of the array and probe all sensors.
+ * Returns:  Number of sensors found
+ **********************************************************************/
+uint8_t dht12_init(void)
+{
+    uint8_t slot;
+    uint8_t found = 0;
+
+    for (slot = 0; slot < DHT12_PIPELINE; slot++)
+    {
+        dht12_trans[slot].address = DHT12_ADDRESS;
+        dht12_trans[slot].reg_len = 1;
+        dht12_trans[slot].reg = 0x00;
+        dht12_trans[slot].rx_buf = dht12_data[slot];
+        dht12_trans[slot].rx_len = sizeof(dht12_data[slot]);
+        dht12_trans[slot].callback = dht12_callback;
+    }
+    for (slot = 0; slot < DHT12_COUNT; slot++)
+    {
+        /* Status of probe is kept until the sensor is read */
+        dht12_sensors[slot].status = twi_probe(DHT12_ADDRESS, DHT12_CHANNEL(slot));
+        if (dht12_sensors[slot].status == TWI_OK)
+        {
+            found++;
+        }
+    }
+
+    /* Speed of sensors behind multiplexer is not probed */
+    if (DHT12_CHANNEL(0) == TWI_DIRECT && found != 0)
+    {
+        twi_dev_probe(DHT12_ADDRESS, DHT12_MAX_KHZ);
+    }
+    return found;
+}
+
+/**********************************************************************
+ * Function: dht12_scan()
+ * Purpose:  Start reading of all sensors in the background.
+ * Returns:  0 - Scan started, 1 - Previous scan is not finished
+ **********************************************************************/
+uint8_t dht12_scan(void)
+{
+    uint8_t i;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (dht12_done < DHT12_COUNT)
+        {
+            return 1;
+        }
+        dht12_scans = (dht12_scans + 1) % DHT12_RESCAN;
+        dht12_next = 0;
+        dht12_done = 0;
+        for (i = 0; i < DHT12_PIPELINE; i++)
+        {
+            dht12_submit(i);
+        }
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Function: dht12_busy()
+ * Purpose:  Test whether a scan is in progress.
+ * Returns:  0 - Scan finished, 1 - Scan in progress
+ **********************************************************************/
+uint8_t dht12_busy(void)
+{
+    return dht12_done < DHT12_COUNT;
+}
+
+/**********************************************************************
+ * Function: dht12_sensor()
+ * Purpose:  Get last values of one sensor.
+ * Input:    index Sensor index
+ * Returns:  Pointer to sensor values, NULL if index is out of range
+ **********************************************************************/
+const dht12_t *dht12_sensor(uint8_t index)
+{
+    if (index >= DHT12_COUNT)
+    {
+        return NULL;
+    }
+    return &dht12_sensors[index];
+}
+
+/**********************************************************************
+ * Function: dht12_stats()
+ * Purpose:  Compute minimum, average and maximum of the last scan.
+ * Input:    stats Aggregated values
+ * Returns:  Number of sensors read successfully
+ **********************************************************************/
+uint8_t dht12_stats(dht12_stats_t *stats)
+{
+    int32_t temp_sum = 0;
+    uint32_t humid_sum = 0;
+    const dht12_t *s;
+
+    stats->count = 0;
+    for (s = dht12_sensors; s < dht12_sensors + DHT12_COUNT; s++)
+    {
+        if (s->status != TWI_OK)
+        {
+            continue;
+        }
+        if (stats->count == 0 || s->temp < stats->temp_min)
+        {
+            stats->temp_min = s->temp;
+        }
+        if (stats->count == 0 || s->temp > stats->temp_max)
+        {
+            stats->temp_max = s->temp;
+        }
+        if (stats->count == 0 || s->humid < stats->humid_min)
+        {
+            stats->humid_min = s->humid;
+        }
+        if (stats->count == 0 || s->humid > stats->humid_max)
+        {
+            stats->humid_max = s->humid;
+        }
+        temp_sum += s->temp;
+        humid_sum += s->humid;
+        stats->count++;
+    }
+    if (stats->count != 0)
+    {
+        stats->temp_avg = temp_sum / stats->count;
+        stats->humid_avg = humid_sum / stats->count;
+    }
+    return stats->count;
+}
@@ -0,0 +1,132 @@
+#ifndef DHT12_H
+# define DHT12_H
+
+/***********************************************************************
+ * 
+ * DHT12 sensor array library for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/**
+ * @file 
+ * @defgroup dht12 DHT12 Library <dht12.h>
+ * @code #include "dht12.h" @endcode
+ *
+ * @brief DHT12 sensor array library for AVR-GCC.
+ *
+ * All DHT12 sensors have the same TWI address, more sensors are
+ * connected through TCA9548A multiplexers. One scan reads all sensors
+ * in the background. DHT12_PIPELINE transactions are kept in the TWI
+ * queue, so the next sensor is started right after STOP of the previous
+ * one without waiting for the application.
+ *
+ * Sensor i is connected to channel i % 8 of multiplexer i / 8. Single
+ * sensor (DHT12_COUNT = 1) is connected directly to the main bus.
+ * Different wiring is defined by macro DHT12_CHANNEL(i).
+ *
+ * Sensors are probed by dht12_init(). Sensors which do not acknowledge
+ * their address are skipped by scans and probed again every
+ * DHT12_RESCAN-th scan.
+ * @{
+ */
+
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+#include "twi.h"
+
+
+/* Defines -----------------------------------------------------------*/
+#define DHT12_ADDRESS 0x5c /**< @brief TWI address of DHT12 */
+#ifndef DHT12_COUNT
+# define DHT12_COUNT 1 /**< @brief Number of sensors, up to 64 */
+#endif
+#ifndef DHT12_CHANNEL
+# if DHT12_COUNT == 1
+#  define DHT12_CHANNEL(i) TWI_DIRECT
+# else
+/** @brief Multiplexer channel of sensor i */
+#  define DHT12_CHANNEL(i) TWI_CHANNEL((i) >> 3, (i) & 0x07)
+# endif
+#endif
+#ifndef DHT12_PIPELINE
+# define DHT12_PIPELINE 2 /**< @brief Transactions of one scan queued at a time */
+#endif
+#ifndef DHT12_RESCAN
+# define DHT12_RESCAN 4 /**< @brief Absent sensors are read once per DHT12_RESCAN scans */
+#endif
+#define DHT12_MAX_KHZ 400 /**< @brief Highest SCL frequency tried for sensor on the main bus */
+
+#define DHT12_ERR_CHECKSUM 0x80 /**< @brief Sensor status: Wrong checksum */
+#define DHT12_ERR_BUSY 0x81 /**< @brief Sensor status: TWI queue was full */
+
+/** @brief Last values of one sensor */
+typedef struct {
+    int16_t temp;           /**< @brief Temperature in 0.1 degC */
+    uint16_t humid;         /**< @brief Relative humidity in 0.1 % */
+    uint8_t status;         /**< @brief twi_status_t or DHT12_ERR_xxx */
+} dht12_t;
+
+/** @brief Aggregated values of sensors read successfully */
+typedef struct {
+    uint8_t count;          /**< @brief Number of sensors read successfully */
+    int16_t temp_min;       /**< @brief Minimal temperature in 0.1 degC */
+    int16_t temp_avg;       /**< @brief Average temperature in 0.1 degC */
+    int16_t temp_max;       /**< @brief Maximal temperature in 0.1 degC */
+    uint16_t humid_min;     /**< @brief Minimal humidity in 0.1 % */
+    uint16_t humid_avg;     /**< @brief Average humidity in 0.1 % */
+    uint16_t humid_max;     /**< @brief Maximal humidity in 0.1 % */
+} dht12_stats_t;
+
+
+/* Function prototypes -----------------------------------------------*/
+/**
+ * @name Functions
+ */
+
+/**
+ * @brief  Prepare transactions of the array and probe all sensors.
+ *         Speed of a sensor on the main bus is probed by twi_dev_probe().
+ * @return Number of sensors found
+ * @note   Blocking function, call after twi_init().
+ */
+uint8_t dht12_init(void);
+
+
+/**
+ * @brief  Start reading of all sensors in the background.
+ * @retval 0 - Scan started
+ * @retval 1 - Previous scan is not finished
+ */
+uint8_t dht12_scan(void);
+
+
+/**
+ * @brief  Test whether a scan is in progress.
+ * @retval 0 - All sensors of the last scan are processed
+ * @retval 1 - Scan in progress
+ */
+uint8_t dht12_busy(void);
+
+
+/**
+ * @brief  Get last values of one sensor.
+ * @param  index Sensor index, 0 to DHT12_COUNT-1
+ * @return Pointer to sensor values, NULL if index is out of range
+ */
+const dht12_t *dht12_sensor(uint8_t index);
+
+
+/**
+ * @brief  Compute minimum, average and maximum of the last scan.
+ * @param  stats Aggregated values, valid only if count is not zero
+ * @return Number of sensors read successfully
+ */
+uint8_t dht12_stats(dht12_stats_t *stats);
+
+/** @} */
+
+#endif
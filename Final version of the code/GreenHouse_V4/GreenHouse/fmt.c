@@ -0,0 +1,200 @@
+/***********************************************************************
+ *
+ * Integer to text formatting library for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/* Includes ----------------------------------------------------------*/
+#include "fmt.h"
+
+/* Variables ---------------------------------------------------------*/
+static const uint16_t fmt_pow10[] = {10000, 1000, 100, 10};
+
+/* Local functions ---------------------------------------------------*/
+/**********************************************************************
+ * Function: fmt_digits()
+ * Purpose:  Get decimal digits of value by subtracting powers of ten.
+ * Input:    digits Buffer for at least 5 digits, not terminated
+ *           value Value to be converted
+ *           min Minimum number of digits, padded by leading zeros
+ * Returns:  Number of digits
+ **********************************************************************/
+static uint8_t fmt_digits(char *digits, uint16_t value, uint8_t min)
+{
+    uint8_t n = 0;
+    uint8_t i;
+    char c;
+
+    for (i = 0; i < sizeof(fmt_pow10) / sizeof(fmt_pow10[0]); i++)
+    {
+        c = '0';
+        while (value >= fmt_pow10[i])
+        {
+            value -= fmt_pow10[i];
+            c++;
+        }
+        if (c != '0' || n != 0 || 5 - i <= min)
+        {
+            digits[n++] = c;
+        }
+    }
+    digits[n++] = '0' + value;
+    return n;
+}
+
+/**********************************************************************
+ * Function: fmt_field()
+ * Purpose:  Write sign, digits and optional decimal point, right
+ *           aligned to width.
+ * Input:    buf, size Buffer for text and its size
+ *           neg Non-zero for minus sign
+ *           digits, n Digits and their number
+ *           point Number of digits after the decimal point
+ *           width Minimum width
+ * Returns:  Length of text, 0 if it does not fit
+ **********************************************************************/
+static uint8_t fmt_field(char *buf, uint8_t size, uint8_t neg, const char *digits,
+                         uint8_t n, uint8_t point, uint8_t width)
+{
+    uint8_t len = n + (neg ? 1 : 0) + (point ? 1 : 0);
+    uint8_t i;
+
+    if (width < len)
+    {
+        width = len;
+    }
+    if (width >= size)
+    {
+        if (size != 0)
+        {
+            buf[0] = '\0';
+        }
+        return 0;
+    }
+
+    for (i = len; i < width; i++)
+    {
+        *buf++ = ' ';
+    }
+    if (neg)
+    {
+        *buf++ = '-';
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (point && i == n - point)
+        {
+            *buf++ = '.';
+        }
+        *buf++ = digits[i];
+    }
+    *buf = '\0';
+    return width;
+}
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: fmt_u8()
+ * Purpose:  Format unsigned 8-bit value in decimal, 8-bit arithmetic.
+ * Input:    buf, size Buffer for text and its size
+ *           value Value to be formatted
+ *           width Minimum width
+ * Returns:  Length of text, 0 if it does not fit
+ **********************************************************************/
+uint8_t fmt_u8(char *buf, uint8_t size, uint8_t value, uint8_t width)
+{
+    char digits[3];
+    uint8_t n = 0;
+    char c;
+
+    if (value >= 100)
+    {
+        c = '0';
+        do
+        {
+            value -= 100;
+            c++;
+        } while (value >= 100);
+        digits[n++] = c;
+    }
+    if (value >= 10 || n != 0)
+    {
+        c = '0';
+        while (value >= 10)
+        {
+            value -= 10;
+            c++;
+        }
+        digits[n++] = c;
+    }
+    digits[n++] = '0' + value;
+    return fmt_field(buf, size, 0, digits, n, 0, width);
+}
+
+/**********************************************************************
+ * Function: fmt_u16()
+ * Purpose:  Format unsigned 16-bit value in decimal.
+ * Input:    buf, size Buffer for text and its size
+ *           value Value to be formatted
+ *           width Minimum width
+ * Returns:  Length of text, 0 if it does not fit
+ **********************************************************************/
+uint8_t fmt_u16(char *buf, uint8_t size, uint16_t value, uint8_t width)
+{
+    char digits[5];
+    uint8_t n = fmt_digits(digits, value, 1);
+
+    return fmt_field(buf, size, 0, digits, n, 0, width);
+}
+
+/**********************************************************************
+ * Function: fmt_s16()
+ * Purpose:  Format signed 16-bit value in decimal.
+ * Input:    buf, size Buffer for text and its size
+ *           value Value to be formatted
+ *           width Minimum width
+ * Returns:  Length of text, 0 if it does not fit
+ **********************************************************************/
+uint8_t fmt_s16(char *buf, uint8_t size, int16_t value, uint8_t width)
+{
+    char digits[5];
+    uint16_t abs_value = (value < 0) ? -(uint16_t)value : (uint16_t)value;
+    uint8_t n = fmt_digits(digits, abs_value, 1);
+
+    return fmt_field(buf, size, value < 0, digits, n, 0, width);
+}
+
+/**********************************************************************
+ * Function: fmt_tenths()
+ * Purpose:  Format value in tenths as fixed point with one decimal.
+ * Input:    buf, size Buffer for text and its size
+ *           value Value in tenths
+ *           width Minimum width
+ * Returns:  Length of text, 0 if it does not fit
+ **********************************************************************/
+uint8_t fmt_tenths(char *buf, uint8_t size, int16_t value, uint8_t width)
+{
+    char digits[5];
+    uint16_t abs_value = (value < 0) ? -(uint16_t)value : (uint16_t)value;
+    uint8_t n = fmt_digits(digits, abs_value, 2);
+
+    return fmt_field(buf, size, value < 0, digits, n, 1, width);
+}
+
+/**********************************************************************
+ * Function: fmt_bcd()
+ * Purpose:  Format packed BCD byte as two ASCII digits.
+ * Input:    buf Buffer for text, at least 3 bytes
+ *           bcd Two BCD digits
+ * Returns:  Length of text, 2
+ **********************************************************************/
+uint8_t fmt_bcd(char *buf, uint8_t bcd)
+{
+    buf[0] = '0' + (bcd >> 4);
+    buf[1] = '0' + (bcd & 0x0f);
+    buf[2] = '\0';
+    return 2;
+}
@@ -0,0 +1,100 @@
+#ifndef FMT_H
+# define FMT_H
+
+/***********************************************************************
+ *
+ * Integer to text formatting library for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/**
+ * @file
+ * @defgroup fmt Formatting Library <fmt.h>
+ * @code #include "fmt.h" @endcode
+ *
+ * @brief Decimal, BCD and fixed-point formatting without division.
+ *
+ * AVR has no divide instruction, so itoa() spends most of its time in
+ * the division library. The functions below get decimal digits by
+ * subtracting powers of ten from a lookup table instead. All of them
+ * write into a caller-provided buffer of given size, right-align the
+ * text to a minimum width by spaces and terminate it. If the text does
+ * not fit, the buffer is set to an empty string.
+ * @{
+ */
+
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+
+
+/* Defines -----------------------------------------------------------*/
+#define FMT_U8_LEN 4        /**< @brief Buffer size for any uint8_t */
+#define FMT_U16_LEN 6       /**< @brief Buffer size for any uint16_t */
+#define FMT_S16_LEN 7       /**< @brief Buffer size for any int16_t */
+#define FMT_TENTHS_LEN 8    /**< @brief Buffer size for any int16_t in tenths */
+
+
+/* Function prototypes -----------------------------------------------*/
+/**
+ * @name Functions
+ */
+
+/**
+ * @brief  Format unsigned 8-bit value in decimal.
+ * @param  buf Buffer for text
+ * @param  size Size of buffer including terminator
+ * @param  value Value to be formatted
+ * @param  width Minimum width, padded by leading spaces
+ * @return Length of text, 0 if it does not fit
+ */
+uint8_t fmt_u8(char *buf, uint8_t size, uint8_t value, uint8_t width);
+
+
+/**
+ * @brief  Format unsigned 16-bit value in decimal.
+ * @param  buf Buffer for text
+ * @param  size Size of buffer including terminator
+ * @param  value Value to be formatted
+ * @param  width Minimum width, padded by leading spaces
+ * @return Length of text, 0 if it does not fit
+ */
+uint8_t fmt_u16(char *buf, uint8_t size, uint16_t value, uint8_t width);
+
+
+/**
+ * @brief  Format signed 16-bit value in decimal.
+ * @param  buf Buffer for text
+ * @param  size Size of buffer including terminator
+ * @param  value Value to be formatted
+ * @param  width Minimum width, padded by leading spaces
+ * @return Length of text, 0 if it does not fit
+ */
+uint8_t fmt_s16(char *buf, uint8_t size, int16_t value, uint8_t width);
+
+
+/**
+ * @brief  Format value in tenths as fixed point "-xx.x".
+ * @param  buf Buffer for text
+ * @param  size Size of buffer including terminator
+ * @param  value Value in tenths, e.g. 0.1 degC
+ * @param  width Minimum width, padded by leading spaces
+ * @return Length of text, 0 if it does not fit
+ */
+uint8_t fmt_tenths(char *buf, uint8_t size, int16_t value, uint8_t width);
+
+
+/**
+ * @brief  Format packed BCD byte as two digits, e.g. RTC registers.
+ * @param  buf Buffer for text, at least 3 bytes
+ * @param  bcd Two BCD digits
+ * @return Length of text, always 2
+ */
+uint8_t fmt_bcd(char *buf, uint8_t bcd);
+
+/** @} */
+
+#endif
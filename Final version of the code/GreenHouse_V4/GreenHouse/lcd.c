@@ -12,8 +12,11 @@
  *     changed lcd_init(), added additional constants for lcd_command(),
  *     added 4-bit I/O mode, improved and optimized code.
  *
- *     Library can be operated in memory mapped mode (LCD_IO_MODE=0) or in
- *     4-bit IO port mode (LCD_IO_MODE=1). 8-bit IO port mode not supported.
+ *     Library can be operated in memory mapped mode (LCD_IO_MODE=LCD_IO_MEMORY),
+ *     in 4-bit IO port mode (LCD_IO_MODE=LCD_IO_4BIT), in 8-bit IO port mode
+ *     (LCD_IO_MODE=LCD_IO_8BIT) or through a PCF8574 I2C backpack
+ *     (LCD_IO_MODE=LCD_IO_I2C). LCD_IO_MODE=LCD_IO_SSD1306 replaces this
+ *     file by ssd1306.c.
  *
  *     Memory mapped mode compatible with Kanda STK200, but supports also
  *     generation of R/W signal through A8 address line.
@@ -26,16 +29,29 @@
 #include <inttypes.h>
 #include <avr/io.h>
 #include <avr/pgmspace.h>
+#include <avr/interrupt.h>
 #ifndef F_CPU
 # define F_CPU 16000000
 #endif
 #include <util/delay.h>
 #include "lcd.h"
+#if LCD_IO_MODE == LCD_IO_I2C
+# include <stddef.h>
+# include "twi.h"
+#endif
+
+#if LCD_IO_MODE != LCD_IO_SSD1306 /* OLED is driven by ssd1306.c */
 
 
 /*
 ** constants/macros
 */
+/* RS, RW, E and data lines driven by port pins */
+#define LCD_IO_PINS (LCD_IO_MODE == LCD_IO_4BIT || LCD_IO_MODE == LCD_IO_8BIT)
+
+#if LCD_IO_MODE == LCD_IO_I2C
+/* LCD on I2C, DDR() and PIN() are defined by twi.h */
+#else
 #define DDR(x) (*(&x - 1)) /* address of data direction register of port x */
 #if defined(__AVR_ATmega64__) || defined(__AVR_ATmega128__)
 /* on ATmega64/128 PINF is on port 0x00 and not 0x60 */
@@ -43,9 +59,10 @@
 #else
 # define PIN(x) (*(&x - 2)) /* address of input register of port x          */
 #endif
+#endif
 
 
-#if LCD_IO_MODE
+#if LCD_IO_PINS
 # define lcd_e_delay()  _delay_us(LCD_DELAY_ENABLE_PULSE)
 # define lcd_e_high()   LCD_E_PORT |= _BV(LCD_E_PIN);
 # define lcd_e_low()    LCD_E_PORT &= ~_BV(LCD_E_PIN);
@@ -56,7 +73,7 @@
 # define lcd_rs_low()   LCD_RS_PORT &= ~_BV(LCD_RS_PIN)
 #endif
 
-#if LCD_IO_MODE
+#if LCD_IO_MODE == LCD_IO_4BIT || LCD_IO_MODE == LCD_IO_I2C
 # if LCD_LINES == 1
 #  define LCD_FUNCTION_DEFAULT LCD_FUNCTION_4BIT_1LINE
 # else
@@ -73,8 +90,13 @@
 #if LCD_CONTROLLER_KS0073
 # if LCD_LINES == 4
 
-#  define KS0073_EXTENDED_FUNCTION_REGISTER_ON  0x2C /* |0|010|1100 4-bit mode, extension-bit RE = 1 */
-#  define KS0073_EXTENDED_FUNCTION_REGISTER_OFF 0x28 /* |0|010|1000 4-bit mode, extension-bit RE = 0 */
+#  if LCD_IO_MODE == LCD_IO_4BIT || LCD_IO_MODE == LCD_IO_I2C
+#   define KS0073_EXTENDED_FUNCTION_REGISTER_ON  0x2C /* |0|010|1100 4-bit mode, extension-bit RE = 1 */
+#   define KS0073_EXTENDED_FUNCTION_REGISTER_OFF 0x28 /* |0|010|1000 4-bit mode, extension-bit RE = 0 */
+#  else
+#   define KS0073_EXTENDED_FUNCTION_REGISTER_ON  0x3C /* |0|011|1100 8-bit mode, extension-bit RE = 1 */
+#   define KS0073_EXTENDED_FUNCTION_REGISTER_OFF 0x38 /* |0|011|1000 8-bit mode, extension-bit RE = 0 */
+#  endif
 #  define KS0073_4LINES_MODE                    0x09 /* |0|000|1001 4 lines mode */
 
 # endif
@@ -83,8 +105,9 @@
 /*
 ** function prototypes
 */
-#if LCD_IO_MODE
+#if LCD_IO_PINS
 static void toggle_e(void);
+static uint8_t lcd_read(uint8_t rs);
 #endif
 
 /*
@@ -99,7 +122,7 @@ static void toggle_e(void);
 #define delay(us) _delay_us(us)
 
 
-#if LCD_IO_MODE
+#if LCD_IO_PINS
 /* toggle Enable Pin to initiate write */
 static void toggle_e(void)
 {
@@ -111,19 +134,146 @@ static void toggle_e(void)
 #endif
 
 
+#if LCD_IO_MODE == LCD_IO_4BIT
+/*
+ * Data pins on consecutive bits of one port are written as a nibble by one masked
+ * store, other mappings bit by bit. Pins are compared by the preprocessor, ports
+ * by a constant expression, so the compiler keeps only one of the two paths.
+ */
+#if (LCD_DATA1_PIN == LCD_DATA0_PIN + 1) && (LCD_DATA2_PIN == LCD_DATA0_PIN + 2) && (LCD_DATA3_PIN == LCD_DATA0_PIN + 3)
+#define LCD_DATA_NIBBLE ( ( &LCD_DATA0_PORT == &LCD_DATA1_PORT) && ( &LCD_DATA1_PORT == &LCD_DATA2_PORT ) && ( &LCD_DATA2_PORT == &LCD_DATA3_PORT ) )
+#else
+#define LCD_DATA_NIBBLE 0
+#endif
+#define LCD_DATA_MASK   (0x0F << LCD_DATA0_PIN)   /* data pins if LCD_DATA_NIBBLE */
+
 /*************************************************************************
-*  Low-level function to write byte to LCD controller
-*  Input:    data   byte to write to LCD
-*         rs     1: write data
-*                0: write instruction
+*  Output 4 bits to consecutive data pins by one masked store
+*  Input:    nibble  bits 0..3 to write to LCD data lines D4..D7
 *  Returns:  none
 *************************************************************************/
-#if LCD_IO_MODE
-static void lcd_write(uint8_t data, uint8_t rs)
+static inline void lcd_nibble_masked(uint8_t nibble)
+{
+    /* port is shared, e.g. with relays, keep interrupts out of read-modify-write */
+    unsigned char sreg = SREG;
+    cli();
+
+    /* configure data pins as output */
+    DDR(LCD_DATA0_PORT) |= LCD_DATA_MASK;
+
+    LCD_DATA0_PORT = (LCD_DATA0_PORT & ~LCD_DATA_MASK) | ((nibble << LCD_DATA0_PIN) & LCD_DATA_MASK);
+    SREG = sreg;
+}/* lcd_nibble_masked */
+
+/*************************************************************************
+*  Output 4 bits to data pins bit by bit
+*  Input:    nibble  bits 0..3 to write to LCD data lines D4..D7
+*  Returns:  none
+*************************************************************************/
+static inline void lcd_nibble_bits(uint8_t nibble)
+{
+    /* configure data pins as output */
+    DDR(LCD_DATA0_PORT) |= _BV(LCD_DATA0_PIN);
+    DDR(LCD_DATA1_PORT) |= _BV(LCD_DATA1_PIN);
+    DDR(LCD_DATA2_PORT) |= _BV(LCD_DATA2_PIN);
+    DDR(LCD_DATA3_PORT) |= _BV(LCD_DATA3_PIN);
+
+    LCD_DATA3_PORT &= ~_BV(LCD_DATA3_PIN);
+    LCD_DATA2_PORT &= ~_BV(LCD_DATA2_PIN);
+    LCD_DATA1_PORT &= ~_BV(LCD_DATA1_PIN);
+    LCD_DATA0_PORT &= ~_BV(LCD_DATA0_PIN);
+    if (nibble & 0x08) LCD_DATA3_PORT |= _BV(LCD_DATA3_PIN);
+    if (nibble & 0x04) LCD_DATA2_PORT |= _BV(LCD_DATA2_PIN);
+    if (nibble & 0x02) LCD_DATA1_PORT |= _BV(LCD_DATA1_PIN);
+    if (nibble & 0x01) LCD_DATA0_PORT |= _BV(LCD_DATA0_PIN);
+}/* lcd_nibble_bits */
+
+/*************************************************************************
+*  Output 4 bits to data pins and toggle Enable
+*  Input:    nibble  bits 0..3 to write to LCD data lines D4..D7
+*  Returns:  none
+*************************************************************************/
+static void lcd_write_nibble(uint8_t nibble)
+{
+    if (LCD_DATA_NIBBLE)
+        lcd_nibble_masked(nibble);
+    else
+        lcd_nibble_bits(nibble);
+    lcd_e_toggle();
+}/* lcd_write_nibble */
+
+#ifdef BENCH
+/*************************************************************************
+*  Output 4 bits to data pins by the stores of lcd_write_nibble(), without
+*  Enable pulse, so the display ignores them. Used by bench_lcd().
+*************************************************************************/
+# if (LCD_DATA1_PIN == LCD_DATA0_PIN + 1) && (LCD_DATA2_PIN == LCD_DATA0_PIN + 2) && (LCD_DATA3_PIN == LCD_DATA0_PIN + 3)
+void lcd_bench_nibble_masked(uint8_t nibble)
+{
+    lcd_nibble_masked(nibble);
+}
+# endif
+
+void lcd_bench_nibble_bits(uint8_t nibble)
 {
-    unsigned char dataBits;
+    lcd_nibble_bits(nibble);
+}
+#endif /* ifdef BENCH */
+
+/*************************************************************************
+*  Set all data pins high (inactive)
+*************************************************************************/
+static void lcd_write_idle(void)
+{
+    if (LCD_DATA_NIBBLE)
+    {
+        unsigned char sreg = SREG;
+        cli();
+        LCD_DATA0_PORT |= LCD_DATA_MASK;
+        SREG = sreg;
+    }
+    else
+    {
+        LCD_DATA0_PORT |= _BV(LCD_DATA0_PIN);
+        LCD_DATA1_PORT |= _BV(LCD_DATA1_PIN);
+        LCD_DATA2_PORT |= _BV(LCD_DATA2_PIN);
+        LCD_DATA3_PORT |= _BV(LCD_DATA3_PIN);
+    }
+}/* lcd_write_idle */
+
+#elif LCD_IO_MODE == LCD_IO_8BIT
+/*************************************************************************
+*  Output byte to data port and toggle Enable
+*  Input:    data  byte to write to LCD data lines D0..D7
+*  Returns:  none
+*************************************************************************/
+static void lcd_write_byte(uint8_t data)
+{
+    /* configure data port as output, port belongs to the LCD */
+    DDR(LCD_DATA_PORT) = 0xFF;
 
+    LCD_DATA_PORT = data;
+    lcd_e_toggle();
+}/* lcd_write_byte */
 
+/*************************************************************************
+*  Set all data pins high (inactive)
+*************************************************************************/
+static void lcd_write_idle(void)
+{
+    LCD_DATA_PORT = 0xFF;
+}/* lcd_write_idle */
+#endif /* if LCD_IO_MODE == LCD_IO_4BIT */
+
+
+#if LCD_IO_PINS
+/*************************************************************************
+*  Set RS line
+*  Input:    rs     1: write data
+*                0: write instruction
+*************************************************************************/
+static inline void lcd_write_rs(uint8_t rs)
+{
     if (rs) /* write data        (RS=1, RW=0) */
     {
         lcd_rs_high();
@@ -133,75 +283,411 @@ static void lcd_write(uint8_t data, uint8_t rs)
         lcd_rs_low();
     }
 
-    /* FRYZA: RW PIN NOT IMPLEMENTED */
-    /*lcd_rw_low();*/    /* RW=0  write mode      */
+    #if LCD_USE_RW
+    lcd_rw_low();    /* RW=0  write mode, otherwise RW is tied to GND */
+    #endif
+}/* lcd_write_rs */
+#endif /* if LCD_IO_PINS */
 
-    if ( ( &LCD_DATA0_PORT == &LCD_DATA1_PORT) && ( &LCD_DATA1_PORT == &LCD_DATA2_PORT ) && ( &LCD_DATA2_PORT == &LCD_DATA3_PORT ) &&
-      (LCD_DATA0_PIN == 0) && (LCD_DATA1_PIN == 1) && (LCD_DATA2_PIN == 2) && (LCD_DATA3_PIN == 3) )
-    {
-        /* configure data pins as output */
-        DDR(LCD_DATA0_PORT) |= 0x0F;
 
-        /* output high nibble first */
-        dataBits       = LCD_DATA0_PORT & 0xF0;
-        LCD_DATA0_PORT = dataBits | ((data >> 4) & 0x0F);
-        lcd_e_toggle();
+#if LCD_IO_PINS && LCD_USE_RW
+static uint8_t lcd_busy_used = 1; /* 0: busy flag timed out or disabled, use delays */
 
-        /* output low nibble */
-        LCD_DATA0_PORT = dataBits | (data & 0x0F);
-        lcd_e_toggle();
+# if !LCD_ASYNC
+/* busy flag reads until timeout, a read takes two enable pulses at least */
+#  define LCD_BUSY_POLLS (LCD_BUSY_TIMEOUT / (2 * LCD_DELAY_ENABLE_PULSE))
 
-        /* all data pins high (inactive) */
-        LCD_DATA0_PORT = dataBits | 0x0F;
-    }
-    else
+/*************************************************************************
+*  Poll busy flag until LCD is ready, switch to delays on timeout
+*************************************************************************/
+static void lcd_wait_ready(void)
+{
+    uint16_t polls;
+
+    if (!lcd_busy_used)
+        return;
+
+    for (polls = LCD_BUSY_POLLS; polls; polls--)
     {
-        /* configure data pins as output */
-        DDR(LCD_DATA0_PORT) |= _BV(LCD_DATA0_PIN);
-        DDR(LCD_DATA1_PORT) |= _BV(LCD_DATA1_PIN);
-        DDR(LCD_DATA2_PORT) |= _BV(LCD_DATA2_PIN);
-        DDR(LCD_DATA3_PORT) |= _BV(LCD_DATA3_PIN);
+        if (!(lcd_read(0) & _BV(LCD_BUSY)))
+            return;
+    }
+    lcd_busy_used = 0; /* no answer, RW line not connected */
+}/* lcd_wait_ready */
+# endif /* if !LCD_ASYNC */
 
-        /* output high nibble first */
-        LCD_DATA3_PORT &= ~_BV(LCD_DATA3_PIN);
-        LCD_DATA2_PORT &= ~_BV(LCD_DATA2_PIN);
-        LCD_DATA1_PORT &= ~_BV(LCD_DATA1_PIN);
-        LCD_DATA0_PORT &= ~_BV(LCD_DATA0_PIN);
-        if (data & 0x80) LCD_DATA3_PORT |= _BV(LCD_DATA3_PIN);
-        if (data & 0x40) LCD_DATA2_PORT |= _BV(LCD_DATA2_PIN);
-        if (data & 0x20) LCD_DATA1_PORT |= _BV(LCD_DATA1_PIN);
-        if (data & 0x10) LCD_DATA0_PORT |= _BV(LCD_DATA0_PIN);
-        lcd_e_toggle();
-
-        /* output low nibble */
-        LCD_DATA3_PORT &= ~_BV(LCD_DATA3_PIN);
-        LCD_DATA2_PORT &= ~_BV(LCD_DATA2_PIN);
-        LCD_DATA1_PORT &= ~_BV(LCD_DATA1_PIN);
-        LCD_DATA0_PORT &= ~_BV(LCD_DATA0_PIN);
-        if (data & 0x08) LCD_DATA3_PORT |= _BV(LCD_DATA3_PIN);
-        if (data & 0x04) LCD_DATA2_PORT |= _BV(LCD_DATA2_PIN);
-        if (data & 0x02) LCD_DATA1_PORT |= _BV(LCD_DATA1_PIN);
-        if (data & 0x01) LCD_DATA0_PORT |= _BV(LCD_DATA0_PIN);
-        lcd_e_toggle();
-
-        /* all data pins high (inactive) */
-        LCD_DATA0_PORT |= _BV(LCD_DATA0_PIN);
-        LCD_DATA1_PORT |= _BV(LCD_DATA1_PIN);
-        LCD_DATA2_PORT |= _BV(LCD_DATA2_PIN);
-        LCD_DATA3_PORT |= _BV(LCD_DATA3_PIN);
+# define LCD_BUSY_USED lcd_busy_used
+#elif LCD_USE_RW
+# error LCD_USE_RW requires LCD_IO_4BIT or LCD_IO_8BIT
+#else
+# define LCD_BUSY_USED 0
+#endif /* if LCD_IO_PINS && LCD_USE_RW */
+
+
+#if LCD_IO_PINS && !LCD_ASYNC
+/*************************************************************************
+*  Low-level function to write byte to LCD controller
+*  Input:    data   byte to write to LCD
+*         rs     1: write data
+*                0: write instruction
+*  Returns:  none
+*************************************************************************/
+static void lcd_write(uint8_t data, uint8_t rs)
+{
+    #if LCD_USE_RW
+    lcd_wait_ready();
+    #endif
+
+    lcd_write_rs(rs);
+
+    #if LCD_IO_MODE == LCD_IO_8BIT
+    /* output whole byte */
+    lcd_write_byte(data);
+    #else
+    /* output high nibble first */
+    lcd_write_nibble(data >> 4);
+
+    /* output low nibble */
+    lcd_write_nibble(data);
+    #endif
 
+    lcd_write_idle();
+
+    if (!LCD_BUSY_USED)
+    {
         /* FRYZA: EXPERIMENTALLY ADDED FOR ARDUINO UNO
          * Delay MUST be greater than 679 us
          */
-        _delay_us(750);
+        delay(LCD_DELAY_WRITE);
     }
 } /* lcd_write */
 
-#else /* if LCD_IO_MODE */
+#elif LCD_IO_PINS /* if LCD_IO_PINS && !LCD_ASYNC */
+
+/* number of lcd_tick() calls covering a delay, the first tick may come at once */
+# define LCD_TICKS(us) (((us) + LCD_TICK_US - 1) / LCD_TICK_US + 1)
+
+# if LCD_QUEUE_SIZE & (LCD_QUEUE_SIZE - 1) || LCD_QUEUE_SIZE % 8
+#  error LCD_QUEUE_SIZE must be a power of 2 and multiple of 8
+# endif
+# if LCD_QUEUE_SIZE > 256
+#  error LCD_QUEUE_SIZE must not exceed 256
+# endif
+# define LCD_QUEUE_MASK (LCD_QUEUE_SIZE - 1)
+
+static uint8_t lcd_queue[LCD_QUEUE_SIZE];               /* bytes to write             */
+static uint8_t lcd_queue_rs[LCD_QUEUE_SIZE / 8];        /* RS of bytes, bit per byte  */
+static volatile uint8_t lcd_queue_head;                 /* next free entry            */
+static volatile uint8_t lcd_queue_tail;                 /* byte being written         */
+static uint8_t lcd_tick_low;                            /* low nibble of tail is next */
+static volatile uint8_t lcd_tick_wait;                  /* ticks until LCD is ready   */
+
+# if LCD_USE_RW
+static uint8_t lcd_tick_busy_count;                     /* ticks the busy flag is set */
+
+/*************************************************************************
+*  Poll busy flag once per tick, switch to delays on timeout
+*  Returns:  1 if LCD is busy
+*************************************************************************/
+static uint8_t lcd_tick_busy(void)
+{
+    if (lcd_busy_used && (lcd_read(0) & _BV(LCD_BUSY)))
+    {
+        if (++lcd_tick_busy_count < LCD_TICKS(LCD_BUSY_TIMEOUT))
+            return 1;
+        lcd_busy_used = 0; /* no answer, RW line not connected */
+    }
+    lcd_tick_busy_count = 0;
+    return 0;
+}/* lcd_tick_busy */
+# else
+#  define lcd_tick_busy() 0
+# endif
+
+/*************************************************************************
+*  Output next nibble (byte in 8-bit mode) of the queue, or count down
+*  delay of the LCD
+*************************************************************************/
+void lcd_tick(void)
+{
+    unsigned char sreg = SREG;
+    uint8_t tail;
+    uint8_t data;
+    uint8_t rs;
+
+    cli();
+    if (lcd_tick_wait)
+    {
+        lcd_tick_wait--;
+    }
+    else if (lcd_queue_head != lcd_queue_tail && (lcd_tick_low || !lcd_tick_busy()))
+    {
+        tail = lcd_queue_tail;
+        data = lcd_queue[tail];
+        rs = lcd_queue_rs[tail >> 3] & (1 << (tail & 7));
+        if (!lcd_tick_low)
+        {
+            lcd_write_rs(rs);
+            #if LCD_IO_MODE == LCD_IO_8BIT
+            lcd_write_byte(data);
+            #else
+            lcd_write_nibble(data >> 4);
+            lcd_tick_low = 1;
+            #endif
+        }
+        #if LCD_IO_MODE == LCD_IO_4BIT
+        else
+        {
+            lcd_write_nibble(data);
+            lcd_tick_low = 0;
+        }
+        #endif
+        if (!lcd_tick_low)
+        {
+            lcd_write_idle();
+
+            /* clear display and return home execute longer */
+            if (LCD_BUSY_USED)
+                lcd_tick_wait = 0;
+            else if (!rs && data < (1 << LCD_ENTRY_MODE))
+                lcd_tick_wait = LCD_TICKS(LCD_DELAY_CLEAR);
+            else
+                lcd_tick_wait = LCD_TICKS(LCD_DELAY_WRITE);
+            lcd_queue_tail = (tail + 1) & LCD_QUEUE_MASK;
+        }
+    }
+    SREG = sreg;
+}/* lcd_tick */
+
+/*************************************************************************
+*  Wait until the queue has a free entry or the LCD executed all bytes
+*  Input:    space  1: wait for free entry
+*                0: wait until queue is empty and LCD is ready
+*************************************************************************/
+static void lcd_queue_wait(uint8_t space)
+{
+    for (;;)
+    {
+        if (space)
+        {
+            if (((lcd_queue_head + 1) & LCD_QUEUE_MASK) != lcd_queue_tail)
+                break;
+        }
+        else if (lcd_queue_head == lcd_queue_tail && !lcd_tick_wait)
+        {
+            break;
+        }
+
+        /* with interrupts disabled the timer interrupt cannot call lcd_tick() */
+        if (!(SREG & _BV(SREG_I)))
+        {
+            delay(LCD_TICK_US);
+            lcd_tick();
+        }
+    }
+}/* lcd_queue_wait */
+
+/*************************************************************************
+*  Number of bytes lcd_write() stores without waiting
+*************************************************************************/
+uint8_t lcd_queue_free(void)
+{
+    return (lcd_queue_tail - lcd_queue_head - 1) & LCD_QUEUE_MASK;
+}/* lcd_queue_free */
+
+/*************************************************************************
+*  Low-level function to store byte in queue, written by lcd_tick()
+*  Input:    data   byte to write to LCD
+*         rs     1: write data
+*                0: write instruction
+*  Returns:  none
+*************************************************************************/
+static void lcd_write(uint8_t data, uint8_t rs)
+{
+    unsigned char sreg = SREG;
+    uint8_t head;
+
+    cli();
+    while (((lcd_queue_head + 1) & LCD_QUEUE_MASK) == lcd_queue_tail)
+    {
+        SREG = sreg;
+        lcd_queue_wait(1);
+        cli();
+    }
+    head = lcd_queue_head;
+    lcd_queue[head] = data;
+    if (rs)
+        lcd_queue_rs[head >> 3] |= (1 << (head & 7));
+    else
+        lcd_queue_rs[head >> 3] &= ~(1 << (head & 7));
+    lcd_queue_head = (head + 1) & LCD_QUEUE_MASK;
+    SREG = sreg;
+}/* lcd_write */
+
+#elif LCD_IO_MODE == LCD_IO_I2C /* if LCD_IO_PINS && !LCD_ASYNC */
+
+# if !LCD_ASYNC
+#  error LCD_IO_I2C requires LCD_ASYNC, batches are sent by lcd_tick()
+# endif
+# if LCD_I2C_BATCH < 5 || LCD_I2C_BATCH > 255
+#  error LCD_I2C_BATCH must be 5 to 255
+# endif
+
+/* number of lcd_tick() calls covering a delay, the first tick may come at once */
+# define LCD_TICKS(us) (((us) + LCD_TICK_US - 1) / LCD_TICK_US + 1)
+
+/* outputs of PCF8574 besides data lines P4..P7 */
+# define LCD_I2C_RS _BV(LCD_I2C_RS_PIN)
+# define LCD_I2C_E  _BV(LCD_I2C_E_PIN)
+# define LCD_I2C_BL _BV(LCD_I2C_BACKLIGHT_PIN)
+
+/*
+ * Bytes are stored as PCF8574 output states in one of two buffers. lcd_tick()
+ * sends the filled buffer as one I2C write when the previous one finished, and
+ * the other buffer is filled meanwhile. With one transaction of the LCD on the
+ * bus at a time, RTC and sensor transactions are queued in between.
+ */
+static uint8_t lcd_i2c_buf[2][LCD_I2C_BATCH];           /* output states to write     */
+static twi_trans_t lcd_i2c_trans = {                    /* write of the sent buffer   */
+    .address = LCD_I2C_ADDRESS
+};
+static uint8_t lcd_i2c_fill;                            /* buffer being filled        */
+static volatile uint8_t lcd_i2c_len;                    /* bytes in buffer being filled */
+static volatile uint8_t lcd_i2c_closed;                 /* buffer ends with clear/home */
+static uint8_t lcd_i2c_last = 0xFF;                     /* RS and backlight outputs   */
+static volatile uint8_t lcd_tick_wait;                  /* ticks until LCD is ready   */
+
+/*************************************************************************
+*  Send filled buffer when the previous write and its delay are finished
+*************************************************************************/
+void lcd_tick(void)
+{
+    unsigned char sreg = SREG;
+
+    cli();
+    if (lcd_i2c_trans.status == TWI_PENDING)
+    {
+        /* previous write still on the bus */
+    }
+    else if (lcd_tick_wait)
+    {
+        lcd_tick_wait--;
+    }
+    else if (lcd_i2c_len != 0)
+    {
+        lcd_i2c_trans.tx_buf = lcd_i2c_buf[lcd_i2c_fill];
+        lcd_i2c_trans.tx_len = lcd_i2c_len;
+        if (twi_submit(&lcd_i2c_trans) == 0) /* else TWI queue full, next tick */
+        {
+            /* clear display and return home execute longer */
+            lcd_tick_wait = lcd_i2c_closed ? LCD_TICKS(LCD_DELAY_CLEAR) : 0;
+            lcd_i2c_fill ^= 1;
+            lcd_i2c_len = 0;
+            lcd_i2c_closed = 0;
+        }
+    }
+    SREG = sreg;
+}/* lcd_tick */
+
+/*************************************************************************
+*  Wait until the buffer being filled has space or the LCD executed all bytes
+*  Input:    space  1: wait for space
+*                0: wait until all is sent and LCD is ready
+*************************************************************************/
+static void lcd_queue_wait(uint8_t space)
+{
+    for (;;)
+    {
+        if (space)
+        {
+            if (!lcd_i2c_closed && lcd_i2c_len <= LCD_I2C_BATCH - 5)
+                break;
+        }
+        else if (lcd_i2c_len == 0 && lcd_i2c_trans.status != TWI_PENDING && !lcd_tick_wait)
+        {
+            break;
+        }
+
+        /* with interrupts disabled the timer interrupt cannot call lcd_tick() */
+        if (!(SREG & _BV(SREG_I)))
+        {
+            twi_wait(&lcd_i2c_trans);   /* services TWI by polling */
+            delay(LCD_TICK_US);
+            lcd_tick();
+        }
+    }
+}/* lcd_queue_wait */
+
+/*************************************************************************
+*  Number of bytes lcd_write() stores without waiting, up to 5 output
+*  states each, none after clear/home until the buffer is sent
+*************************************************************************/
+uint8_t lcd_queue_free(void)
+{
+    if (lcd_i2c_closed)
+        return 0;
+    return (LCD_I2C_BATCH - lcd_i2c_len) / 5;
+}/* lcd_queue_free */
+
+/*************************************************************************
+*  Low-level function to store byte as PCF8574 output states, both nibbles
+*  are strobed by E high and low, RS is set before E if it changes
+*  Input:    data   byte to write to LCD
+*         rs     1: write data
+*                0: write instruction
+*  Returns:  none
+*************************************************************************/
+static void lcd_write(uint8_t data, uint8_t rs)
+{
+    unsigned char sreg = SREG;
+    uint8_t ctrl = LCD_I2C_BL | (rs ? LCD_I2C_RS : 0);
+    uint8_t *buf;
+    uint8_t len;
+
+    cli();
+    while (lcd_i2c_closed || lcd_i2c_len > LCD_I2C_BATCH - 5)
+    {
+        SREG = sreg;
+        lcd_queue_wait(1);
+        cli();
+    }
+    buf = lcd_i2c_buf[lcd_i2c_fill];
+    len = lcd_i2c_len;
+    if (ctrl != lcd_i2c_last)
+    {
+        buf[len++] = ctrl;          /* RS set up before E rises */
+        lcd_i2c_last = ctrl;
+    }
+    buf[len++] = ctrl | (data & 0xF0) | LCD_I2C_E;
+    buf[len++] = ctrl | (data & 0xF0);
+    buf[len++] = ctrl | (data << 4) | LCD_I2C_E;
+    buf[len++] = ctrl | (data << 4);
+    lcd_i2c_len = len;
+    if (!rs && data < (1 << LCD_ENTRY_MODE))
+        lcd_i2c_closed = 1;         /* next byte after the delay of clear/home */
+    SREG = sreg;
+}/* lcd_write */
+
+/*************************************************************************
+*  Write one nibble of the reset sequence, waits until it is sent
+*************************************************************************/
+static void lcd_i2c_nibble(uint8_t nibble)
+{
+    uint8_t buf[2];
+
+    buf[0] = LCD_I2C_BL | (nibble << 4) | LCD_I2C_E;
+    buf[1] = LCD_I2C_BL | (nibble << 4);
+    twi_transfer(LCD_I2C_ADDRESS, buf, sizeof(buf), NULL, 0);
+}/* lcd_i2c_nibble */
+
+#else /* if LCD_IO_PINS && !LCD_ASYNC */
+# if LCD_ASYNC
+#  error LCD_ASYNC requires LCD_IO_4BIT, LCD_IO_8BIT or LCD_IO_I2C
+# endif
 # define lcd_write(d, rs) if (rs) *(volatile uint8_t *) (LCD_IO_DATA) = d; else *(volatile uint8_t *) (LCD_IO_FUNCTION) = d;
 /* rs==0 -> write instruction to LCD_IO_FUNCTION */
 /* rs==1 -> write data to LCD_IO_DATA */
-#endif /* if LCD_IO_MODE */
+#endif /* if LCD_IO_PINS && !LCD_ASYNC */
 
 
 /*************************************************************************
@@ -210,8 +696,8 @@ static void lcd_write(uint8_t data, uint8_t rs)
 *                0: read busy flag / address counter
 *  Returns:  byte read from LCD controller
 *************************************************************************/
-#if LCD_IO_MODE
-/* FRYZA: RW PIN NOT IMPLEMENTED ==> DO NOT USE THIS FUNCTION */
+#if LCD_IO_MODE == LCD_IO_4BIT
+/* needs RW line, see LCD_USE_RW */
 static uint8_t lcd_read(uint8_t rs)
 {
     uint8_t data;
@@ -222,21 +708,20 @@ static uint8_t lcd_read(uint8_t rs)
         lcd_rs_low();  /* RS=0: read busy flag */
     lcd_rw_high();     /* RW=1  read mode      */
 
-    if ( ( &LCD_DATA0_PORT == &LCD_DATA1_PORT) && ( &LCD_DATA1_PORT == &LCD_DATA2_PORT ) && ( &LCD_DATA2_PORT == &LCD_DATA3_PORT ) &&
-      ( LCD_DATA0_PIN == 0 ) && (LCD_DATA1_PIN == 1) && (LCD_DATA2_PIN == 2) && (LCD_DATA3_PIN == 3) )
+    if (LCD_DATA_NIBBLE)
     {
-        DDR(LCD_DATA0_PORT) &= 0xF0; /* configure data pins as input */
+        DDR(LCD_DATA0_PORT) &= ~LCD_DATA_MASK; /* configure data pins as input */
 
         lcd_e_high();
         lcd_e_delay();
-        data = PIN(LCD_DATA0_PORT) << 4; /* read high nibble first */
+        data = ((PIN(LCD_DATA0_PORT) & LCD_DATA_MASK) >> LCD_DATA0_PIN) << 4; /* read high nibble first */
         lcd_e_low();
 
         lcd_e_delay(); /* Enable 500ns low       */
 
         lcd_e_high();
         lcd_e_delay();
-        data |= PIN(LCD_DATA0_PORT) & 0x0F; /* read low nibble        */
+        data |= (PIN(LCD_DATA0_PORT) & LCD_DATA_MASK) >> LCD_DATA0_PIN; /* read low nibble        */
         lcd_e_low();
     }
     else
@@ -271,6 +756,30 @@ static uint8_t lcd_read(uint8_t rs)
     return data;
 } /* lcd_read */
 
+#elif LCD_IO_MODE == LCD_IO_8BIT
+static uint8_t lcd_read(uint8_t rs)
+{
+    uint8_t data;
+
+    if (rs)
+        lcd_rs_high();  /* RS=1: read data      */
+    else
+        lcd_rs_low();  /* RS=0: read busy flag */
+    lcd_rw_high();     /* RW=1  read mode      */
+
+    DDR(LCD_DATA_PORT) = 0x00; /* configure data port as input */
+
+    lcd_e_high();
+    lcd_e_delay();
+    data = PIN(LCD_DATA_PORT); /* read whole byte       */
+    lcd_e_low();
+
+    return data;
+} /* lcd_read */
+
+#elif LCD_IO_MODE == LCD_IO_I2C
+# define lcd_read(rs) 0 /* RW of backpack kept low, lcd_getxy() returns 0 */
+
 #else /* if LCD_IO_MODE */
 # define lcd_read(rs) (rs) ? *(volatile uint8_t *) (LCD_IO_DATA + LCD_IO_READ) : *(volatile uint8_t *) (LCD_IO_FUNCTION + LCD_IO_READ)
 /* rs==0 -> read instruction from LCD_IO_FUNCTION */
@@ -280,8 +789,8 @@ static uint8_t lcd_read(uint8_t rs)
 
 /*************************************************************************
 *  loops while lcd is busy, returns address counter
+*  needs RW line in 4-bit and 8-bit mode, see LCD_USE_RW
 *************************************************************************/
-/* FRYZA: RW PIN NOT IMPLEMENTED ==> DO NOT USE THIS FUNCTION */
 static uint8_t lcd_waitbusy(void)
 {
     register uint8_t c;
@@ -349,8 +858,6 @@ static inline void lcd_newline(uint8_t pos)
 *************************************************************************/
 void lcd_command(uint8_t cmd)
 {
-    /* FRYZA: RW PIN NOT IMPLEMENTED ==> DO NOT USE READ FUNCTION */
-    /* lcd_waitbusy(); */
     lcd_write(cmd, 0);
 }
 
@@ -361,8 +868,6 @@ void lcd_command(uint8_t cmd)
 *************************************************************************/
 void lcd_data(uint8_t data)
 {
-    /* FRYZA: RW PIN NOT IMPLEMENTED ==> DO NOT USE READ FUNCTION */
-    /* lcd_waitbusy(); */
     lcd_write(data, 1);
 }
 
@@ -396,8 +901,9 @@ void lcd_gotoxy(uint8_t x, uint8_t y)
 }/* lcd_gotoxy */
 
 /*************************************************************************
+*  Return address counter, needs RW line in 4-bit and 8-bit mode,
+*  see LCD_USE_RW
 *************************************************************************/
-/* FRYZA: RW PIN NOT IMPLEMENTED ==> DO NOT USE THIS FUNCTION */
 int lcd_getxy(void)
 {
     return lcd_waitbusy();
@@ -426,44 +932,10 @@ void lcd_home(void)
 *************************************************************************/
 void lcd_putc(char c)
 {
-    /* FRYZA: RW PIN NOT IMPLEMENTED ==> DO NOT CALL LCD_WAITBUSY FUNCTION */
-
-    /*    uint8_t pos;
-     *
-     *  pos = lcd_waitbusy();   // read busy-flag and address counter
-     *  if (c=='\n')
-     *  {
-     *      lcd_newline(pos);
-     *  }
-     *  else
-     *  {
-     #if LCD_WRAP_LINES==1
-     #if LCD_LINES==1
-     *      if ( pos == LCD_START_LINE1+LCD_DISP_LENGTH ) {
-     *          lcd_write((1<<LCD_DDRAM)+LCD_START_LINE1,0);
-     *      }
-     #elif LCD_LINES==2
-     *      if ( pos == LCD_START_LINE1+LCD_DISP_LENGTH ) {
-     *          lcd_write((1<<LCD_DDRAM)+LCD_START_LINE2,0);
-     *      }else if ( pos == LCD_START_LINE2+LCD_DISP_LENGTH ){
-     *          lcd_write((1<<LCD_DDRAM)+LCD_START_LINE1,0);
-     *      }
-     #elif LCD_LINES==4
-     *      if ( pos == LCD_START_LINE1+LCD_DISP_LENGTH ) {
-     *          lcd_write((1<<LCD_DDRAM)+LCD_START_LINE2,0);
-     *      }else if ( pos == LCD_START_LINE2+LCD_DISP_LENGTH ) {
-     *          lcd_write((1<<LCD_DDRAM)+LCD_START_LINE3,0);
-     *      }else if ( pos == LCD_START_LINE3+LCD_DISP_LENGTH ) {
-     *          lcd_write((1<<LCD_DDRAM)+LCD_START_LINE4,0);
-     *      }else if ( pos == LCD_START_LINE4+LCD_DISP_LENGTH ) {
-     *          lcd_write((1<<LCD_DDRAM)+LCD_START_LINE1,0);
-     *      }
-     #endif
-     *      lcd_waitbusy();
-     #endif
+    /* '\n' and line wrap are not handled, they need the address counter,
+     * which cannot be read with RW tied to GND (LCD_USE_RW 0)
      */
     lcd_write(c, 1);
-    //    }
 }/* lcd_putc */
 
 /*************************************************************************
@@ -498,6 +970,55 @@ void lcd_puts_p(const char *progmem_s)
     }
 }/* lcd_puts_p */
 
+/*************************************************************************
+*  Wait until all queued bytes are executed by the LCD
+*************************************************************************/
+void lcd_sync(void)
+{
+    #if LCD_ASYNC
+    lcd_queue_wait(0);
+    #endif
+}/* lcd_sync */
+
+#if !LCD_ASYNC
+/*************************************************************************
+*  Nothing to output, bytes are written at once
+*************************************************************************/
+void lcd_tick(void)
+{
+}/* lcd_tick */
+
+/*************************************************************************
+*  No queue, every byte is written at once
+*************************************************************************/
+uint8_t lcd_queue_free(void)
+{
+    return 255;
+}/* lcd_queue_free */
+#endif
+
+#if LCD_USE_RW
+/*************************************************************************
+*  Select polling of busy flag or worst-case delays
+*  Input:    on  1: poll busy flag, 0: use delays
+*  Returns:  none
+*************************************************************************/
+void lcd_use_busy_flag(uint8_t on)
+{
+    lcd_sync();
+    delay(LCD_DELAY_CLEAR); /* last byte may still execute, also without delay */
+    lcd_busy_used = on;
+}/* lcd_use_busy_flag */
+
+/*************************************************************************
+*  Check whether the busy flag is polled
+*************************************************************************/
+uint8_t lcd_busy_flag_used(void)
+{
+    return lcd_busy_used;
+}/* lcd_busy_flag_used */
+#endif
+
 /*************************************************************************
 *  Initialize display and select type of cursor
 *  Input:    dispAttr LCD_DISP_OFF            display off
@@ -508,7 +1029,9 @@ void lcd_puts_p(const char *progmem_s)
 *************************************************************************/
 void lcd_init(uint8_t dispAttr)
 {
-    #if LCD_IO_MODE
+    lcd_sync(); /* queued bytes must not interleave with reset sequence */
+
+    #if LCD_IO_MODE == LCD_IO_4BIT
 
     /*
      *  Initialize LCD to 4 bit I/O mode
@@ -522,26 +1045,32 @@ void lcd_init(uint8_t dispAttr)
         /* configure all port bits as output (all LCD lines on same port) */
         DDR(LCD_DATA0_PORT) |= 0x7F;
     }
-    else if ( ( &LCD_DATA0_PORT == &LCD_DATA1_PORT) && ( &LCD_DATA1_PORT == &LCD_DATA2_PORT ) && ( &LCD_DATA2_PORT == &LCD_DATA3_PORT ) &&
-      (LCD_DATA0_PIN == 0 ) && (LCD_DATA1_PIN == 1) && (LCD_DATA2_PIN == 2) && (LCD_DATA3_PIN == 3) )
+    else if (LCD_DATA_NIBBLE)
     {
         /* configure all port bits as output (all LCD data lines on same port, but control lines on different ports) */
-        DDR(LCD_DATA0_PORT) |= 0x0F;
+        DDR(LCD_DATA0_PORT) |= LCD_DATA_MASK;
         DDR(LCD_RS_PORT)    |= _BV(LCD_RS_PIN);
+        #if LCD_USE_RW
         DDR(LCD_RW_PORT)    |= _BV(LCD_RW_PIN);
+        #endif
         DDR(LCD_E_PORT)     |= _BV(LCD_E_PIN);
     }
     else
     {
         /* configure all port bits as output (LCD data and control lines on different ports */
         DDR(LCD_RS_PORT)    |= _BV(LCD_RS_PIN);
+        #if LCD_USE_RW
         DDR(LCD_RW_PORT)    |= _BV(LCD_RW_PIN);
+        #endif
         DDR(LCD_E_PORT)     |= _BV(LCD_E_PIN);
         DDR(LCD_DATA0_PORT) |= _BV(LCD_DATA0_PIN);
         DDR(LCD_DATA1_PORT) |= _BV(LCD_DATA1_PIN);
         DDR(LCD_DATA2_PORT) |= _BV(LCD_DATA2_PIN);
         DDR(LCD_DATA3_PORT) |= _BV(LCD_DATA3_PIN);
     }
+    #if LCD_USE_RW
+    lcd_rw_low(); /* RW=0  write mode for the reset sequence */
+    #endif
     delay(LCD_DELAY_BOOTUP); /* wait 16ms or more after power-on       */
 
     /* initial write to lcd is 8bit */
@@ -563,6 +1092,59 @@ void lcd_init(uint8_t dispAttr)
     lcd_e_toggle();
     delay(LCD_DELAY_INIT_4BIT); /* some displays need this additional delay */
 
+    /* from now the LCD only accepts 4 bit I/O, we can use lcd_command() */
+    #elif LCD_IO_MODE == LCD_IO_8BIT
+
+    /*
+     *  Initialize LCD to 8 bit I/O mode
+     */
+    DDR(LCD_DATA_PORT) = 0xFF; /* whole port belongs to the LCD */
+    DDR(LCD_RS_PORT)  |= _BV(LCD_RS_PIN);
+    #if LCD_USE_RW
+    DDR(LCD_RW_PORT)  |= _BV(LCD_RW_PIN);
+    lcd_rw_low(); /* RW=0  write mode for the reset sequence */
+    #endif
+    DDR(LCD_E_PORT)   |= _BV(LCD_E_PIN);
+    lcd_rs_low(); /* RS=0  instructions */
+    delay(LCD_DELAY_BOOTUP); /* wait 16ms or more after power-on       */
+
+    /* reset by function set 8bit, three times */
+    LCD_DATA_PORT = LCD_FUNCTION_8BIT_1LINE;
+    lcd_e_toggle();
+    delay(LCD_DELAY_INIT); /* delay, busy flag can't be checked here */
+
+    /* repeat last command */
+    lcd_e_toggle();
+    delay(LCD_DELAY_INIT_REP); /* delay, busy flag can't be checked here */
+
+    /* repeat last command a third time */
+    lcd_e_toggle();
+    delay(LCD_DELAY_INIT_REP); /* delay, busy flag can't be checked here */
+
+    /* the LCD stays in 8 bit I/O, we can use lcd_command() */
+    #elif LCD_IO_MODE == LCD_IO_I2C
+
+    /*
+     *  Initialize LCD to 4 bit I/O mode through PCF8574, TWI must be initialized
+     */
+    delay(LCD_DELAY_BOOTUP); /* wait 16ms or more after power-on       */
+
+    /* initial write to lcd is 8bit */
+    lcd_i2c_nibble(LCD_FUNCTION_8BIT_1LINE >> 4);
+    delay(LCD_DELAY_INIT); /* delay, busy flag can't be checked here */
+
+    /* repeat last command */
+    lcd_i2c_nibble(LCD_FUNCTION_8BIT_1LINE >> 4);
+    delay(LCD_DELAY_INIT_REP); /* delay, busy flag can't be checked here */
+
+    /* repeat last command a third time */
+    lcd_i2c_nibble(LCD_FUNCTION_8BIT_1LINE >> 4);
+    delay(LCD_DELAY_INIT_REP); /* delay, busy flag can't be checked here */
+
+    /* now configure for 4bit mode */
+    lcd_i2c_nibble(LCD_FUNCTION_4BIT_1LINE >> 4);
+    delay(LCD_DELAY_INIT_4BIT); /* some displays need this additional delay */
+
     /* from now the LCD only accepts 4 bit I/O, we can use lcd_command() */
     #else /* if LCD_IO_MODE */
 
@@ -595,4 +1177,7 @@ void lcd_init(uint8_t dispAttr)
     lcd_clrscr();                  /* display clear                */
     lcd_command(LCD_MODE_DEFAULT); /* set entry mode               */
     lcd_command(dispAttr);         /* display/cursor control       */
+    lcd_sync();
 }/* lcd_init */
+
+#endif /* if LCD_IO_MODE != LCD_IO_SSD1306 */
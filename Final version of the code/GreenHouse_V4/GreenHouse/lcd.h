@@ -21,8 +21,11 @@
  * The Hitachi HD44780 controller and its compatible controllers like Samsung KS0066U have become an industry standard for these types of displays.
  *
  * This library allows easy interfacing with a HD44780 compatible display and can be
- * operated in memory mapped mode (LCD_IO_MODE defined as 0 in the include file lcd.h.) or in
- * 4-bit IO port mode (LCD_IO_MODE defined as 1). 8-bit IO port mode is not supported.
+ * operated in memory mapped mode (LCD_IO_MODE defined as LCD_IO_MEMORY), in
+ * 4-bit IO port mode (LCD_IO_MODE defined as LCD_IO_4BIT), in 8-bit IO port mode
+ * (LCD_IO_MODE defined as LCD_IO_8BIT) or through a PCF8574 I2C backpack
+ * (LCD_IO_MODE defined as LCD_IO_I2C). With LCD_IO_MODE defined as LCD_IO_SSD1306,
+ * the same functions draw characters on a 128x64 I2C OLED, see ssd1306.c.
  *
  * Memory mapped mode is compatible with old Kanda STK200 starter kit, but also supports
  * generation of R/W signal through A8 address line.
@@ -48,6 +51,15 @@
 
 /**@{*/
 
+/**
+ * @name  Definitions for LCD_IO_MODE
+ */
+#define LCD_IO_MEMORY 0 /**< memory mapped mode */
+#define LCD_IO_4BIT   1 /**< 4-bit IO port mode */
+#define LCD_IO_I2C    2 /**< 4-bit mode through PCF8574 I2C port expander, uses TWI library */
+#define LCD_IO_8BIT   3 /**< 8-bit IO port mode, data lines on one whole port */
+#define LCD_IO_SSD1306 4 /**< 128x64 OLED with SSD1306 controller on I2C, 8x8 pixels per character, uses TWI library */
+
 /*
  * LCD and target specific definitions below can be defined in a separate include file with name lcd_definitions.h instead modifying this file
  * All definitions added to the file lcd_definitions.h will override the default definitions from lcd.h
@@ -99,7 +111,7 @@
 
 
 /**
- * @name Definitions for 4-bit IO mode
+ * @name Definitions for 4-bit and 8-bit IO mode
  *
  * The four LCD data lines and the three control lines RS, RW, E can be on the
  * same port or on different ports.
@@ -110,15 +122,20 @@
  * is possible to connect these data lines in different order or even on different
  * ports by adapting the LCD_DATAx_PORT and LCD_DATAx_PIN definitions.
  *
+ * In 8-bit IO mode (LCD_IO_8BIT) the eight data lines occupy the whole port
+ * LCD_DATA_PORT, which halves the Enable pulses per byte.
+ *
  * Adjust these definitions to your target.\n
  * These definitions can be defined in a separate include file \b lcd_definitions.h instead modifying this file by
  * adding \b -D_LCD_DEFINITIONS_FILE to the \b CDEFS section in the Makefile.
  * All definitions added to the file lcd_definitions.h will override the default definitions from lcd.h
  *
  */
-#define LCD_IO_MODE 1 /**< 0: memory mapped mode, 1: IO port mode */
+#ifndef LCD_IO_MODE
+# define LCD_IO_MODE LCD_IO_4BIT /**< LCD_IO_MEMORY, LCD_IO_4BIT, LCD_IO_8BIT, LCD_IO_I2C or LCD_IO_SSD1306 */
+#endif
 
-#if LCD_IO_MODE
+#if LCD_IO_MODE == LCD_IO_4BIT
 
 # ifndef LCD_PORT
 #  define LCD_PORT PORTA /**< port for the LCD lines   */
@@ -166,9 +183,78 @@
 #  define LCD_E_PIN 6 /**< pin  for Enable line     */
 # endif
 
-#elif defined(__AVR_AT90S4414__) || defined(__AVR_AT90S8515__) || defined(__AVR_ATmega64__) || \
+#elif LCD_IO_MODE == LCD_IO_8BIT
+
+/*
+ * Data lines D0..D7 are bits 0..7 of LCD_DATA_PORT, so each byte is written by
+ * one port store and one Enable pulse. The control lines can be on any port.
+ */
+# ifndef LCD_DATA_PORT
+#  define LCD_DATA_PORT PORTA /**< port for 8bit data, whole port */
+# endif
+# ifndef LCD_PORT
+#  define LCD_PORT PORTC /**< port for the control lines */
+# endif
+# ifndef LCD_RS_PORT
+#  define LCD_RS_PORT LCD_PORT /**< port for RS line         */
+# endif
+# ifndef LCD_RS_PIN
+#  define LCD_RS_PIN 0 /**< pin  for RS line         */
+# endif
+# ifndef LCD_RW_PORT
+#  define LCD_RW_PORT LCD_PORT /**< port for RW line         */
+# endif
+# ifndef LCD_RW_PIN
+#  define LCD_RW_PIN 1 /**< pin  for RW line         */
+# endif
+# ifndef LCD_E_PORT
+#  define LCD_E_PORT LCD_PORT /**< port for Enable line     */
+# endif
+# ifndef LCD_E_PIN
+#  define LCD_E_PIN 2 /**< pin  for Enable line     */
+# endif
+
+#elif LCD_IO_MODE == LCD_IO_I2C
+
+/*
+ * Outputs P0..P7 of the PCF8574 as wired on the common LCD backpacks,
+ * data lines D4..D7 are always connected to P4..P7
+ */
+# ifndef LCD_I2C_ADDRESS
+#  define LCD_I2C_ADDRESS 0x27 /**< 7-bit address of PCF8574, 0x3F for PCF8574A */
+# endif
+# ifndef LCD_I2C_RS_PIN
+#  define LCD_I2C_RS_PIN 0 /**< output for RS line       */
+# endif
+# ifndef LCD_I2C_RW_PIN
+#  define LCD_I2C_RW_PIN 1 /**< output for RW line, kept low */
+# endif
+# ifndef LCD_I2C_E_PIN
+#  define LCD_I2C_E_PIN 2 /**< output for Enable line   */
+# endif
+# ifndef LCD_I2C_BACKLIGHT_PIN
+#  define LCD_I2C_BACKLIGHT_PIN 3 /**< output for backlight, kept on */
+# endif
+# ifndef LCD_I2C_BATCH
+#  define LCD_I2C_BATCH ((LCD_DISP_LENGTH + 1) * 4 + 2) /**< bytes of one I2C write, a line with its address */
+# endif
+
+#elif LCD_IO_MODE == LCD_IO_SSD1306
+
+/*
+ * The OLED is a grid of 16 x 8 characters of 8x8 pixels, set LCD_LINES to 8
+ * to use the whole panel. Only characters changed since the last write are sent.
+ */
+# ifndef LCD_SSD1306_ADDRESS
+#  define LCD_SSD1306_ADDRESS 0x3C /**< 7-bit address of SSD1306, 0x3D with SA0 high */
+# endif
+# ifndef LCD_SSD1306_BATCH
+#  define LCD_SSD1306_BATCH 4 /**< characters of one I2C write, 8 bytes each */
+# endif
+
+#elif LCD_IO_MODE == LCD_IO_MEMORY && (defined(__AVR_AT90S4414__) || defined(__AVR_AT90S8515__) || defined(__AVR_ATmega64__) || \
     defined(__AVR_ATmega8515__) || defined(__AVR_ATmega103__) || defined(__AVR_ATmega128__) || \
-    defined(__AVR_ATmega161__) || defined(__AVR_ATmega162__)
+    defined(__AVR_ATmega161__) || defined(__AVR_ATmega162__))
 
 /*
  * memory mapped mode is only supported when the device has an external data memory interface
@@ -177,9 +263,12 @@
 # define LCD_IO_FUNCTION 0x8000 /* A15=E=1, A14=RS=0                 */
 # define LCD_IO_READ     0x0100 /* A8 =R/W=1 (R/W: 1=Read, 0=Write   */
 
-#else // if LCD_IO_MODE
+#elif LCD_IO_MODE == LCD_IO_MEMORY
 # error "external data memory interface not available for this device, use 4-bit IO port mode"
 
+#else // if LCD_IO_MODE
+# error "unknown LCD_IO_MODE"
+
 #endif // if LCD_IO_MODE
 
 
@@ -211,6 +300,58 @@
 #ifndef LCD_DELAY_ENABLE_PULSE
 # define LCD_DELAY_ENABLE_PULSE 1 /**< enable signal pulse width in micro seconds */
 #endif
+#ifndef LCD_DELAY_WRITE
+# define LCD_DELAY_WRITE 750 /**< delay in micro seconds after a byte is written without busy flag, > 679 us on Arduino Uno */
+#endif
+#ifndef LCD_DELAY_CLEAR
+# define LCD_DELAY_CLEAR 2000 /**< delay in micro seconds after clear display or return home command */
+#endif
+#ifndef LCD_BUSY_TIMEOUT
+# define LCD_BUSY_TIMEOUT 4000 /**< time in micro seconds the busy flag may stay set before delays are used */
+#endif
+
+
+/**
+ * @name Definitions for busy flag
+ *
+ * With LCD_USE_RW defined as 1, the RW line on LCD_RW_PORT/LCD_RW_PIN is driven
+ * and the busy flag is polled before each byte instead of waiting the worst-case
+ * delays after it. If the flag stays set for LCD_BUSY_TIMEOUT micro seconds,
+ * e.g. RW is not connected, the library falls back to the delays.
+ *
+ * Do not enable if RW is tied to GND, reading would then write to the LCD.
+ * Only supported in 4-bit and 8-bit IO port modes.
+ */
+#ifndef LCD_USE_RW
+# define LCD_USE_RW 0 /**< 0: RW not connected, delays only, 1: poll busy flag */
+#endif
+
+
+/**
+ * @name Definitions for queued output
+ *
+ * With LCD_ASYNC defined as 1, lcd_command(), lcd_data(), lcd_putc() and the
+ * functions using them only store the byte in a queue and return. The function
+ * lcd_tick(), called from a timer interrupt every LCD_TICK_US micro seconds,
+ * outputs one nibble (one byte in 8-bit IO port mode) per call and counts the
+ * delays of the LCD in ticks, so
+ * no function waits for the display. If the queue is full, the function waits
+ * for space, with interrupts disabled it sends the queue itself by waiting.
+ * lcd_sync() waits until the queue is empty.
+ *
+ * Supported in 4-bit and 8-bit IO port modes and required by I2C mode, where lcd_tick()
+ * sends all bytes queued since the last transaction as one I2C write, and by SSD1306
+ * mode, where lcd_tick() sends changed characters of one line as one I2C write.
+ */
+#ifndef LCD_ASYNC
+# define LCD_ASYNC 0 /**< 0: wait for each byte, 1: queue bytes for lcd_tick() */
+#endif
+#ifndef LCD_QUEUE_SIZE
+# define LCD_QUEUE_SIZE 64 /**< size of queue in bytes, power of 2 and multiple of 8 */
+#endif
+#ifndef LCD_TICK_US
+# define LCD_TICK_US 128 /**< period of lcd_tick() calls in micro seconds */
+#endif
 
 
 /**
@@ -309,6 +450,17 @@ extern void lcd_home(void);
 extern void lcd_gotoxy(uint8_t x, uint8_t y);
 
 
+/**
+ * @brief    Get cursor position
+ *
+ * Returns the address counter of the HD44780, which is read over RW and
+ * needs LCD_USE_RW in 4-bit and 8-bit mode. The I2C backpack keeps RW low
+ * and returns 0, the SSD1306 returns line * LCD_DISP_LENGTH + column.
+ * @return   cursor position
+ */
+extern int lcd_getxy(void);
+
+
 /**
  * @brief    Display character at current cursor position
  * @param    c character to be displayed
@@ -352,6 +504,78 @@ extern void lcd_command(uint8_t cmd);
 extern void lcd_data(uint8_t data);
 
 
+/**
+ * @brief    Output next nibble of the queue, call every LCD_TICK_US micro seconds
+ *
+ * Does nothing unless LCD_ASYNC is 1.
+ * @return   none
+ */
+extern void lcd_tick(void);
+
+
+/**
+ * @brief    Wait until all queued bytes are executed by the LCD
+ *
+ * Does nothing unless LCD_ASYNC is 1. With interrupts disabled, e.g. during
+ * initialization, the queue is sent by waiting instead of lcd_tick() calls.
+ * @return   none
+ */
+extern void lcd_sync(void);
+
+
+/**
+ * @brief    Get number of bytes that can be written without waiting
+ *
+ * With LCD_ASYNC 1, lcd_command() and lcd_data() wait while the queue is full.
+ * Code in interrupt service routines, like lcd_fb_flush() and lcd_glyph(), writes
+ * at most this many bytes and continues at its next call.
+ * @return   free bytes of the queue, 255 if bytes are written at once
+ */
+extern uint8_t lcd_queue_free(void);
+
+
+#if LCD_USE_RW
+/**
+ * @brief    Select polling of busy flag or worst-case delays
+ *
+ * Waits until the LCD is ready and then switches the mode, e.g. to compare both.
+ * @param    on 1: poll busy flag, 0: use delays
+ * @return   none
+ */
+extern void lcd_use_busy_flag(uint8_t on);
+
+
+/**
+ * @brief    Check whether the busy flag is polled
+ * @return   1: busy flag polled, 0: delays used, also after a busy flag timeout
+ */
+extern uint8_t lcd_busy_flag_used(void);
+#endif
+
+
+#if defined(BENCH) && LCD_IO_MODE == LCD_IO_4BIT
+/**
+ * @brief    Output nibble to data pins by the masked store of lcd_write_nibble()
+ *
+ * Enable stays low, so the display ignores the data pins. Only for bench.c,
+ * defined when LCD_DATA0_PIN to LCD_DATA3_PIN are consecutive.
+ * @param    nibble bits 0..3 to write to LCD data lines D4..D7
+ * @return   none
+ */
+extern void lcd_bench_nibble_masked(uint8_t nibble);
+
+
+/**
+ * @brief    Output nibble to data pins bit by bit as lcd_write_nibble() does
+ *
+ * Enable stays low, so the display ignores the data pins. Only for bench.c.
+ * @param    nibble bits 0..3 to write to LCD data lines D4..D7
+ * @return   none
+ */
+extern void lcd_bench_nibble_bits(uint8_t nibble);
+#endif
+
+
 /**
  * @brief macros for automatically storing string constant in program memory
  */
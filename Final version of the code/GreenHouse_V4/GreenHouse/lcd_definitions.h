@@ -50,7 +50,9 @@
  *
  * The four LCD data lines and the two control lines RS, E can be on the
  * same port or on different ports. R/W pin is directly connected to GND
- * on LCD Keypad Shield and cannot be controlled.
+ * on LCD Keypad Shield and cannot be controlled. Data lines on
+ * consecutive pins of one port, like PD4 to PD7, are written by one
+ * masked store per nibble instead of bit by bit.
  *
  * @note All definitions added to the file lcd_definitions.h will 
  * override the default definitions from lcd.h. Add -D_LCD_DEFINITIONS_FILE
@@ -71,6 +73,41 @@
 #define LCD_E_PIN       PB1
 // R/W pin is connected to GND on LCD Keypad Shield
 
+/**
+ * @name Definitions for IO mode
+ * The LCD Keypad Shield drives the display by port pins in 4-bit mode.
+ * For a display with PCF8574 I2C backpack, set LCD_IO_MODE to
+ * LCD_IO_I2C and LCD_I2C_ADDRESS to 0x27 (PCF8574) or 0x3f (PCF8574A).
+ * I2C mode requires LCD_ASYNC. On boards with a spare whole port, e.g.
+ * PORTA of ATmega2560, LCD_IO_8BIT with LCD_DATA_PORT sends each byte
+ * by one Enable pulse instead of two. For a 128x64 SSD1306 OLED, set
+ * LCD_IO_MODE to LCD_IO_SSD1306 and LCD_LINES to 8; it shows 8 lines
+ * of 16 characters and also requires LCD_ASYNC.
+ */
+#define LCD_IO_MODE     LCD_IO_4BIT
+#define LCD_I2C_ADDRESS 0x27
+#define LCD_SSD1306_ADDRESS 0x3C
+
+/**
+ * @name Definitions for busy flag
+ * R/W is tied to GND on the LCD Keypad Shield, so the busy flag cannot
+ * be read and worst-case delays are used. If R/W of the display is
+ * wired to a free pin, set LCD_USE_RW to 1 and define the pin, e.g.
+ * PB3, to poll the busy flag instead.
+ */
+#define LCD_USE_RW      0
+#define LCD_RW_PORT     PORTB
+#define LCD_RW_PIN      PB3
+
+/**
+ * @name Definitions for queued output
+ * Bytes are queued and sent by lcd_tick() from Timer/Counter2 overflow
+ * interrupt every 128 us, so the timer interrupt of the application
+ * does not wait for the display.
+ */
+#define LCD_ASYNC       1
+#define LCD_TICK_US     128 /**< @brief Timer/Counter2 overflow period */
+
 /** @} */
 
 #endif
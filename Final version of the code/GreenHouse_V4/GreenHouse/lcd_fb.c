@@ -0,0 +1,160 @@
+/***********************************************************************
+ *
+ * Shadow framebuffer for HD44780 LCD library for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/* Includes ----------------------------------------------------------*/
+#include <string.h>
+#include "lcd_fb.h"
+
+/* Variables ---------------------------------------------------------*/
+static char lcd_fb_buf[LCD_LINES][LCD_DISP_LENGTH];     // Wanted contents
+static char lcd_fb_shown[LCD_LINES][LCD_DISP_LENGTH];   // Contents of LCD
+static uint8_t lcd_fb_stale[LCD_LINES][(LCD_DISP_LENGTH + 7) / 8];  // Shown cell unknown, bit per cell
+static uint8_t lcd_fb_x = 0;                            // Write position
+static uint8_t lcd_fb_y = 0;
+
+/* Local functions ---------------------------------------------------*/
+/**********************************************************************
+ * Function: lcd_fb_is_dirty()
+ * Purpose:  Test whether a cell differs from the LCD. Writing a field
+ *           with spaces and then the same text again changes nothing.
+ * Input:    x, y Column and line of cell
+ * Returns:  Non-zero if changed
+ **********************************************************************/
+static inline uint8_t lcd_fb_is_dirty(uint8_t x, uint8_t y)
+{
+    return (lcd_fb_stale[y][x / 8] & (1 << (x % 8))) ||
+           lcd_fb_buf[y][x] != lcd_fb_shown[y][x];
+}
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: lcd_fb_init()
+ * Purpose:  Fill buffer with spaces like a cleared display.
+ * Returns:  none
+ **********************************************************************/
+void lcd_fb_init(void)
+{
+    memset(lcd_fb_buf, ' ', sizeof(lcd_fb_buf));
+    memset(lcd_fb_shown, ' ', sizeof(lcd_fb_shown));
+    memset(lcd_fb_stale, 0, sizeof(lcd_fb_stale));
+    lcd_fb_x = 0;
+    lcd_fb_y = 0;
+}
+
+/**********************************************************************
+ * Function: lcd_fb_invalidate()
+ * Purpose:  Mark all cells changed, next flush sends whole buffer.
+ * Returns:  none
+ **********************************************************************/
+void lcd_fb_invalidate(void)
+{
+    memset(lcd_fb_stale, 0xff, sizeof(lcd_fb_stale));
+}
+
+/**********************************************************************
+ * Function: lcd_fb_gotoxy()
+ * Purpose:  Set write position in buffer.
+ * Input:    x Column
+ *           y Line
+ * Returns:  none
+ **********************************************************************/
+void lcd_fb_gotoxy(uint8_t x, uint8_t y)
+{
+    lcd_fb_x = x;
+    lcd_fb_y = y;
+}
+
+/**********************************************************************
+ * Function: lcd_fb_putc()
+ * Purpose:  Store character at write position.
+ * Input:    c Character
+ * Returns:  none
+ **********************************************************************/
+void lcd_fb_putc(char c)
+{
+    if (lcd_fb_x < LCD_DISP_LENGTH && lcd_fb_y < LCD_LINES)
+    {
+        lcd_fb_buf[lcd_fb_y][lcd_fb_x++] = c;
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_fb_puts()
+ * Purpose:  Store string from write position.
+ * Input:    s Terminated string
+ * Returns:  none
+ **********************************************************************/
+void lcd_fb_puts(const char *s)
+{
+    while (*s != '\0')
+    {
+        lcd_fb_putc(*s++);
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_fb_flush()
+ * Purpose:  Send runs of cells differing from the LCD. A run is
+ *           extended over up to LCD_FB_MERGE_GAP unchanged cells if
+ *           another changed cell follows, and the address is only set
+ *           when the run does not start where the previous one ended.
+ *           Only bytes fitting in the LCD queue are written, the cells
+ *           left over stay changed for the next flush.
+ * Returns:  none
+ **********************************************************************/
+void lcd_fb_flush(void)
+{
+    uint8_t x, y;
+    uint8_t end;
+    uint8_t i;
+    uint8_t next_x = LCD_DISP_LENGTH;   // LCD address unknown
+    uint8_t space = lcd_queue_free();   // Bytes written without waiting
+
+    for (y = 0; y < LCD_LINES; y++)
+    {
+        x = 0;
+        while (x < LCD_DISP_LENGTH)
+        {
+            if (!lcd_fb_is_dirty(x, y))
+            {
+                x++;
+                continue;
+            }
+
+            // Find last changed cell of run
+            end = x;
+            for (i = x + 1; i < LCD_DISP_LENGTH && i - end <= LCD_FB_MERGE_GAP + 1; i++)
+            {
+                if (lcd_fb_is_dirty(i, y))
+                {
+                    end = i;
+                }
+            }
+
+            // Address and at least one cell, else LCD queue is full
+            if (space < ((x != next_x) ? 2 : 1))
+            {
+                return;
+            }
+            if (x != next_x)
+            {
+                lcd_gotoxy(x, y);
+                space--;
+            }
+            for (; x <= end && space != 0; x++, space--)
+            {
+                lcd_data(lcd_fb_buf[y][x]);
+                lcd_fb_shown[y][x] = lcd_fb_buf[y][x];
+                lcd_fb_stale[y][x / 8] &= ~(1 << (x % 8));
+            }
+            next_x = x;
+        }
+        next_x = LCD_DISP_LENGTH;       // Next line needs address
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef LCD_FB_H
+# define LCD_FB_H
+
+/***********************************************************************
+ *
+ * Shadow framebuffer for HD44780 LCD library for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/**
+ * @file
+ * @defgroup lcd_fb LCD Framebuffer <lcd_fb.h>
+ * @code #include "lcd_fb.h" @endcode
+ *
+ * @brief Copy of the LCD contents in RAM, only changed cells are sent.
+ *
+ * Every byte sent to the LCD costs two nibble writes and the delay of
+ * the LCD library. Application code writes into a buffer of LCD_LINES
+ * x LCD_DISP_LENGTH characters instead, which costs a few cycles per
+ * character, so a field may be cleared and redrawn freely.
+ * lcd_fb_flush() compares the buffer with a second copy holding what
+ * the LCD shows and sends the differing cells only. Changed cells
+ * separated by at most LCD_FB_MERGE_GAP unchanged cells are sent as one
+ * run, so the DDRAM address auto-increment replaces the address
+ * command.
+ *
+ * lcd_fb_flush() never waits for the LCD. It writes only as many bytes
+ * as fit in the queue of the LCD library and leaves the other changed
+ * cells for the next call, so it can run in a timer interrupt.
+ *
+ * The buffer is not protected against concurrent access, so write and
+ * flush it from one context only.
+ * @{
+ */
+
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+#include "lcd.h"
+
+
+/* Defines -----------------------------------------------------------*/
+#ifndef LCD_FB_MERGE_GAP
+/**
+ * @brief Unchanged cells resent to join two runs. Both an address
+ *        command and a data byte cost one write, so gap 1 breaks even.
+ */
+# define LCD_FB_MERGE_GAP 1
+#endif
+
+
+/* Function prototypes -----------------------------------------------*/
+/**
+ * @name Functions
+ */
+
+/**
+ * @brief  Fill buffer with spaces, all cells unchanged.
+ * @return none
+ * @note   Call after lcd_init(), which clears the display.
+ */
+void lcd_fb_init(void);
+
+
+/**
+ * @brief  Mark all cells changed, e.g. after the display was cleared
+ *         or written directly by the LCD library.
+ * @return none
+ */
+void lcd_fb_invalidate(void);
+
+
+/**
+ * @brief  Set position of next character written into buffer.
+ * @param  x Column, 0 is left most
+ * @param  y Line, 0 is top
+ * @return none
+ */
+void lcd_fb_gotoxy(uint8_t x, uint8_t y);
+
+
+/**
+ * @brief  Write character into buffer and advance position.
+ * @param  c Character, 0 to 7 are CGRAM characters
+ * @return none
+ * @note   Characters beyond the end of a line are dropped, there is no
+ *         wrap to the next line.
+ */
+void lcd_fb_putc(char c);
+
+
+/**
+ * @brief  Write string into buffer.
+ * @param  s Terminated string
+ * @return none
+ */
+void lcd_fb_puts(const char *s);
+
+
+/**
+ * @brief  Send changed cells to the LCD, as many as fit in its queue.
+ * @return none
+ * @note   Call periodically, cells left over are sent at the next call.
+ */
+void lcd_fb_flush(void);
+
+/** @} */
+
+#endif
@@ -0,0 +1,224 @@
+/***********************************************************************
+ *
+ * Custom character store and CGRAM cache for HD44780 LCD for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/pgmspace.h>
+#include <string.h>
+#include "lcd_glyph.h"
+#include "lcd.h"
+
+/* Defines -----------------------------------------------------------*/
+#define LCD_GLYPH_ROWS 8        // Rows of 5x8 character
+#define LCD_GLYPH_NONE 0xff     // Slot is empty
+
+/* Variables ---------------------------------------------------------*/
+static const uint8_t lcd_glyph_rows[LCD_GLYPH_RAM0][LCD_GLYPH_ROWS] PROGMEM = {
+    [LCD_GLYPH_DROP] = {
+        0b00000,
+        0b00100,
+        0b01110,
+        0b11111,
+        0b11111,
+        0b11111,
+        0b01110,
+        0b00000
+    },
+    [LCD_GLYPH_THERMO] = {
+        0b00100,
+        0b01010,
+        0b01110,
+        0b01110,
+        0b01110,
+        0b10101,
+        0b11111,
+        0b01110
+    },
+    [LCD_GLYPH_BULB] = {
+        0b01110,
+        0b10001,
+        0b10001,
+        0b10101,
+        0b10101,
+        0b01110,
+        0b01110,
+        0b00100
+    },
+    [LCD_GLYPH_BAR1] = {
+        0b10000, 0b10000, 0b10000, 0b10000, 0b10000, 0b10000, 0b10000, 0b10000
+    },
+    [LCD_GLYPH_BAR2] = {
+        0b11000, 0b11000, 0b11000, 0b11000, 0b11000, 0b11000, 0b11000, 0b11000
+    },
+    [LCD_GLYPH_BAR3] = {
+        0b11100, 0b11100, 0b11100, 0b11100, 0b11100, 0b11100, 0b11100, 0b11100
+    },
+    [LCD_GLYPH_BAR4] = {
+        0b11110, 0b11110, 0b11110, 0b11110, 0b11110, 0b11110, 0b11110, 0b11110
+    }
+};
+
+static uint8_t lcd_glyph_slot[LCD_GLYPH_SLOTS];  // Glyph in each CGRAM slot
+static uint8_t lcd_glyph_lru[LCD_GLYPH_SLOTS];   // Slots, most recently used first
+static uint8_t lcd_glyph_ram[LCD_GLYPH_RAM_COUNT][LCD_GLYPH_ROWS];   // Glyphs defined at run time
+static uint8_t lcd_glyph_changed[LCD_GLYPH_RAM_COUNT];  // Rows not uploaded yet, bit per row
+static uint8_t lcd_glyph_pending[LCD_GLYPH_SLOTS];      // Rows of slot left for next upload
+
+/* Local functions ---------------------------------------------------*/
+/**********************************************************************
+ * Function: lcd_glyph_touch()
+ * Purpose:  Move slot to the front of the LRU list.
+ * Input:    pos Position of slot in the list
+ * Returns:  none
+ **********************************************************************/
+static void lcd_glyph_touch(uint8_t pos)
+{
+    uint8_t slot = lcd_glyph_lru[pos];
+
+    for (; pos > 0; pos--)
+    {
+        lcd_glyph_lru[pos] = lcd_glyph_lru[pos - 1];
+    }
+    lcd_glyph_lru[0] = slot;
+}
+
+/**********************************************************************
+ * Function: lcd_glyph_upload()
+ * Purpose:  Write rows of glyph into CGRAM slot. The address is only
+ *           set before a row that does not follow the previous one.
+ *           Stops when the LCD queue is full instead of waiting.
+ * Input:    glyph Glyph to be uploaded
+ *           slot CGRAM slot
+ *           mask Rows to be uploaded, bit per row
+ * Returns:  Rows not uploaded, bit per row
+ **********************************************************************/
+static uint8_t lcd_glyph_upload(uint8_t glyph, uint8_t slot, uint8_t mask)
+{
+    uint8_t next = LCD_GLYPH_ROWS;      // CGRAM address unknown
+    uint8_t space = lcd_queue_free();   // Bytes written without waiting
+    uint8_t i;
+
+    for (i = 0; i < LCD_GLYPH_ROWS; i++)
+    {
+        if (!(mask & (1 << i)))
+        {
+            continue;
+        }
+        if (space < ((i != next) ? 2 : 1))
+        {
+            break;
+        }
+        if (i != next)
+        {
+            lcd_command((1 << LCD_CGRAM) | (slot * LCD_GLYPH_ROWS + i));
+            space--;
+        }
+        if (glyph >= LCD_GLYPH_RAM0)
+        {
+            lcd_data(lcd_glyph_ram[glyph - LCD_GLYPH_RAM0][i]);
+        }
+        else
+        {
+            lcd_data(pgm_read_byte(&lcd_glyph_rows[glyph][i]));
+        }
+        space--;
+        mask &= ~(1 << i);
+        next = i + 1;
+    }
+    return mask;
+}
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: lcd_glyph_init()
+ * Purpose:  Mark all slots empty, slot 0 is used first.
+ * Returns:  none
+ **********************************************************************/
+void lcd_glyph_init(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < LCD_GLYPH_SLOTS; i++)
+    {
+        lcd_glyph_slot[i] = LCD_GLYPH_NONE;
+        lcd_glyph_lru[i] = LCD_GLYPH_SLOTS - 1 - i;
+    }
+    memset(lcd_glyph_ram, 0, sizeof(lcd_glyph_ram));
+    memset(lcd_glyph_changed, 0, sizeof(lcd_glyph_changed));
+    memset(lcd_glyph_pending, 0, sizeof(lcd_glyph_pending));
+}
+
+/**********************************************************************
+ * Function: lcd_glyph()
+ * Purpose:  Find glyph in CGRAM, otherwise upload it to the least
+ *           recently used slot. Changed rows of a resident glyph
+ *           defined at run time are uploaded again. Rows that do not
+ *           fit in the LCD queue are uploaded by the next call.
+ * Input:    glyph Glyph to be displayed
+ * Returns:  Character code of slot
+ **********************************************************************/
+char lcd_glyph(lcd_glyph_t glyph)
+{
+    uint8_t pos;
+    uint8_t slot;
+
+    for (pos = 0; pos < LCD_GLYPH_SLOTS; pos++)
+    {
+        if (lcd_glyph_slot[lcd_glyph_lru[pos]] == glyph)
+        {
+            break;
+        }
+    }
+    if (pos < LCD_GLYPH_SLOTS)
+    {
+        lcd_glyph_touch(pos);
+        slot = lcd_glyph_lru[0];
+    }
+    else
+    {
+        // Not resident, replace least recently used glyph
+        lcd_glyph_touch(LCD_GLYPH_SLOTS - 1);
+        slot = lcd_glyph_lru[0];
+        lcd_glyph_slot[slot] = glyph;
+        lcd_glyph_pending[slot] = 0xff;
+    }
+
+    if (glyph >= LCD_GLYPH_RAM0)
+    {
+        lcd_glyph_pending[slot] |= lcd_glyph_changed[glyph - LCD_GLYPH_RAM0];
+        lcd_glyph_changed[glyph - LCD_GLYPH_RAM0] = 0;
+    }
+    if (lcd_glyph_pending[slot] != 0)
+    {
+        lcd_glyph_pending[slot] = lcd_glyph_upload(glyph, slot, lcd_glyph_pending[slot]);
+    }
+    return slot;
+}
+
+/**********************************************************************
+ * Function: lcd_glyph_define()
+ * Purpose:  Change bitmap of glyph defined at run time and remember
+ *           which rows differ from CGRAM.
+ * Input:    glyph LCD_GLYPH_RAM0 to LCD_GLYPH_RAM3
+ *           rows 8 rows of 5 bits
+ * Returns:  none
+ **********************************************************************/
+void lcd_glyph_define(lcd_glyph_t glyph, const uint8_t *rows)
+{
+    uint8_t *ram = lcd_glyph_ram[glyph - LCD_GLYPH_RAM0];
+    uint8_t i;
+
+    for (i = 0; i < LCD_GLYPH_ROWS; i++)
+    {
+        if (ram[i] != rows[i])
+        {
+            ram[i] = rows[i];
+            lcd_glyph_changed[glyph - LCD_GLYPH_RAM0] |= 1 << i;
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef LCD_GLYPH_H
+# define LCD_GLYPH_H
+
+/***********************************************************************
+ *
+ * Custom character store and CGRAM cache for HD44780 LCD for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/**
+ * @file
+ * @defgroup lcd_glyph LCD Glyphs <lcd_glyph.h>
+ * @code #include "lcd_glyph.h" @endcode
+ *
+ * @brief Custom characters kept in flash, uploaded to CGRAM on demand.
+ *
+ * The HD44780 holds 8 custom characters in CGRAM. Glyphs are stored in
+ * program memory as 8 rows of 5 bits each. lcd_glyph() returns the
+ * character code of a glyph and uploads it only if it is not resident,
+ * replacing the least recently used one, so more than 8 glyphs can be
+ * used across screens.
+ *
+ * Glyphs LCD_GLYPH_RAM0 to LCD_GLYPH_RAM3 are kept in RAM and changed
+ * by lcd_glyph_define(), e.g. for graphs. If such a glyph is resident,
+ * the next lcd_glyph() uploads only its rows that changed.
+ *
+ * Uploads never wait for the LCD. Rows that do not fit in the queue of
+ * the LCD library are uploaded by the next lcd_glyph() of the glyph.
+ *
+ * A replaced glyph changes on the display too. Call lcd_glyph() for
+ * every glyph each time a screen is drawn, and use at most 8 different
+ * glyphs on one screen.
+ * @{
+ */
+
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+
+
+/* Defines -----------------------------------------------------------*/
+#define LCD_GLYPH_SLOTS 8   /**< @brief Custom characters in CGRAM */
+
+/** @brief Glyphs in program memory */
+typedef enum {
+    LCD_GLYPH_DROP,         /**< @brief Drop, soil moisture */
+    LCD_GLYPH_THERMO,       /**< @brief Thermometer, temperature */
+    LCD_GLYPH_BULB,         /**< @brief Bulb, light level */
+    LCD_GLYPH_BAR1,         /**< @brief Bar graph cell, 1 column filled */
+    LCD_GLYPH_BAR2,         /**< @brief Bar graph cell, 2 columns filled */
+    LCD_GLYPH_BAR3,         /**< @brief Bar graph cell, 3 columns filled */
+    LCD_GLYPH_BAR4,         /**< @brief Bar graph cell, 4 columns filled */
+    LCD_GLYPH_RAM0,         /**< @brief First glyph defined at run time */
+    LCD_GLYPH_RAM1,         /**< @brief Glyph defined at run time */
+    LCD_GLYPH_RAM2,         /**< @brief Glyph defined at run time */
+    LCD_GLYPH_RAM3,         /**< @brief Glyph defined at run time */
+    LCD_GLYPH_COUNT         /**< @brief Number of glyphs */
+} lcd_glyph_t;
+
+#define LCD_GLYPH_RAM_COUNT (LCD_GLYPH_COUNT - LCD_GLYPH_RAM0) /**< @brief Glyphs defined at run time */
+
+
+/* Function prototypes -----------------------------------------------*/
+/**
+ * @name Functions
+ */
+
+/**
+ * @brief  Mark all CGRAM slots empty.
+ * @return none
+ * @note   Call after lcd_init().
+ */
+void lcd_glyph_init(void);
+
+
+/**
+ * @brief  Get character code of glyph, upload it to CGRAM if needed.
+ * @param  glyph Glyph to be displayed
+ * @return Character code 0 to 7
+ * @note   An upload leaves the LCD address in CGRAM, set the cursor by
+ *         lcd_gotoxy() before writing characters directly.
+ */
+char lcd_glyph(lcd_glyph_t glyph);
+
+
+/**
+ * @brief  Change bitmap of glyph defined at run time.
+ * @param  glyph LCD_GLYPH_RAM0 to LCD_GLYPH_RAM3
+ * @param  rows 8 rows, bits 4 (left) to 0 (right)
+ * @return none
+ * @note   Nothing is sent to the LCD, the changed rows are uploaded by
+ *         the next lcd_glyph() of the glyph.
+ */
+void lcd_glyph_define(lcd_glyph_t glyph, const uint8_t *rows);
+
+/** @} */
+
+#endif
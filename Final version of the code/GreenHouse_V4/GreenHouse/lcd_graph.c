@@ -0,0 +1,138 @@
+/***********************************************************************
+ *
+ * Bar graphs and sparklines for HD44780 LCD for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/* Includes ----------------------------------------------------------*/
+#include "lcd_graph.h"
+
+/* Defines -----------------------------------------------------------*/
+#define LCD_GRAPH_FULL 0xff     // Full block of HD44780 character ROM
+#define LCD_GRAPH_COLUMNS 5     // Columns of 5x8 character
+#define LCD_GRAPH_ROWS 8        // Rows of 5x8 character
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: lcd_graph_bar()
+ * Purpose:  Draw bar of width * 5 steps, full cells, one partial cell
+ *           and spaces.
+ * Input:    width Cells of graph
+ *           value Value, clipped to max
+ *           max Value of full graph
+ * Returns:  none
+ **********************************************************************/
+void lcd_graph_bar(uint8_t width, uint16_t value, uint16_t max)
+{
+    uint16_t steps;
+    uint8_t i;
+
+    if (value > max)
+    {
+        value = max;
+    }
+    steps = (uint32_t)value * width * LCD_GRAPH_COLUMNS / max;
+
+    for (i = 0; i < width; i++)
+    {
+        if (steps >= LCD_GRAPH_COLUMNS)
+        {
+            lcd_fb_putc(LCD_GRAPH_FULL);
+            steps -= LCD_GRAPH_COLUMNS;
+        }
+        else if (steps != 0)
+        {
+            lcd_fb_putc(lcd_glyph(LCD_GLYPH_BAR1 + steps - 1));
+            steps = 0;
+        }
+        else
+        {
+            lcd_fb_putc(' ');
+        }
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_graph_push()
+ * Purpose:  Store value in ring of history.
+ * Input:    hist History
+ *           value Value
+ * Returns:  none
+ **********************************************************************/
+void lcd_graph_push(lcd_graph_hist_t *hist, uint16_t value)
+{
+    hist->samples[hist->next] = value;
+    if (++hist->next == LCD_GRAPH_SAMPLES)
+    {
+        hist->next = 0;
+    }
+    if (hist->count < LCD_GRAPH_SAMPLES)
+    {
+        hist->count++;
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_graph_spark()
+ * Purpose:  Build columns of history in RAM glyphs and draw them. The
+ *           height is scaled by multiplication, dividing only once.
+ * Input:    hist History
+ *           max Value of full height
+ *           first First RAM glyph
+ * Returns:  none
+ **********************************************************************/
+void lcd_graph_spark(const lcd_graph_hist_t *hist, uint16_t max, lcd_glyph_t first)
+{
+    uint32_t scale = (((uint32_t)LCD_GRAPH_ROWS << 16) + max - 1) / max;
+    uint8_t rows[LCD_GRAPH_ROWS];
+    uint8_t missing = LCD_GRAPH_SAMPLES - hist->count;
+    uint8_t index = hist->next;     // Oldest value
+    uint8_t height;
+    uint8_t cell, column, row;
+    uint16_t value;
+
+    if (hist->count < LCD_GRAPH_SAMPLES)
+    {
+        index = 0;
+    }
+
+    for (cell = 0; cell < LCD_GRAPH_CELLS; cell++)
+    {
+        for (row = 0; row < LCD_GRAPH_ROWS; row++)
+        {
+            rows[row] = 0;
+        }
+        // Columns 4 to 1 of the cell, column 0 stays empty as a gap
+        for (column = 0; column < 4; column++)
+        {
+            if (missing != 0)
+            {
+                missing--;      /* Right aligned, no value yet */
+                continue;
+            }
+            value = hist->samples[index];
+            if (++index == LCD_GRAPH_SAMPLES)
+            {
+                index = 0;
+            }
+            if (value > max)
+            {
+                value = max;
+            }
+            height = (value * scale) >> 16;
+            if (height > LCD_GRAPH_ROWS)
+            {
+                height = LCD_GRAPH_ROWS;
+            }
+            for (row = LCD_GRAPH_ROWS - height; row < LCD_GRAPH_ROWS; row++)
+            {
+                rows[row] |= 1 << (LCD_GRAPH_COLUMNS - 1 - column);
+            }
+        }
+        lcd_glyph_define(first + cell, rows);
+        lcd_fb_putc(lcd_glyph(first + cell));
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef LCD_GRAPH_H
+# define LCD_GRAPH_H
+
+/***********************************************************************
+ *
+ * Bar graphs and sparklines for HD44780 LCD for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/**
+ * @file
+ * @defgroup lcd_graph LCD Graphs <lcd_graph.h>
+ * @code #include "lcd_graph.h" @endcode
+ *
+ * @brief Horizontal bar graphs and sparklines drawn into the framebuffer.
+ *
+ * A bar graph fills 5 columns per cell using the full block of the
+ * character ROM and glyphs LCD_GLYPH_BAR1 to LCD_GLYPH_BAR4, so it
+ * needs at most one glyph.
+ *
+ * A sparkline shows the last LCD_GRAPH_SAMPLES values of a history as
+ * columns 8 pixels high, 4 columns per cell, the newest on the right.
+ * The bitmaps are built in RAM glyphs LCD_GLYPH_RAM0 to LCD_GLYPH_RAM3
+ * by lcd_glyph_define(), so only rows that changed are uploaded.
+ *
+ * Both can be drawn on every update, an unchanged graph costs no LCD
+ * writes.
+ * @{
+ */
+
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+#include "lcd_fb.h"
+#include "lcd_glyph.h"
+
+
+/* Defines -----------------------------------------------------------*/
+#define LCD_GRAPH_SAMPLES 16    /**< @brief Samples of history shown by sparkline */
+#define LCD_GRAPH_CELLS (LCD_GRAPH_SAMPLES / 4) /**< @brief Cells of sparkline */
+
+/** @brief History of values for sparkline */
+typedef struct {
+    uint16_t samples[LCD_GRAPH_SAMPLES];    /**< @brief Ring of values */
+    uint8_t next;           /**< @brief Index written next, the oldest value */
+    uint8_t count;          /**< @brief Number of valid values */
+} lcd_graph_hist_t;
+
+
+/* Function prototypes -----------------------------------------------*/
+/**
+ * @name Functions
+ */
+
+/**
+ * @brief  Draw horizontal bar graph at the framebuffer position.
+ * @param  width Cells of graph
+ * @param  value Value, clipped to max
+ * @param  max Value of full graph, not 0
+ * @return none
+ */
+void lcd_graph_bar(uint8_t width, uint16_t value, uint16_t max);
+
+
+/**
+ * @brief  Add value to history, replacing the oldest one.
+ * @param  hist History
+ * @param  value Value
+ * @return none
+ */
+void lcd_graph_push(lcd_graph_hist_t *hist, uint16_t value);
+
+
+/**
+ * @brief  Draw sparkline of history at the framebuffer position.
+ * @param  hist History
+ * @param  max Value of full height, not 0
+ * @param  first First of LCD_GRAPH_CELLS consecutive RAM glyphs
+ * @return none
+ */
+void lcd_graph_spark(const lcd_graph_hist_t *hist, uint16_t max, lcd_glyph_t first);
+
+/** @} */
+
+#endif
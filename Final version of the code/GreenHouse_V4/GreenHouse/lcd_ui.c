@@ -0,0 +1,305 @@
+/***********************************************************************
+ *
+ * Screen layout engine for HD44780 LCD for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/* Includes ----------------------------------------------------------*/
+#include <string.h>
+#include "lcd_ui.h"
+#include "fmt.h"
+
+/* Defines -----------------------------------------------------------*/
+#define LCD_UI_VALUE_LEN 3      // Bytes of largest bound value, time
+#define LCD_UI_TEXT_LEN (LCD_DISP_LENGTH + 1)   // Longest text of field
+
+/* Variables ---------------------------------------------------------*/
+static const lcd_ui_page_t *lcd_ui_pages;   // Table of pages in flash
+static uint8_t lcd_ui_count = 0;            // Number of pages
+static uint8_t lcd_ui_page = 0;             // Page shown
+static uint8_t lcd_ui_drawn = 0;            // Page drawn into framebuffer
+static uint16_t lcd_ui_period = 0;          // Updates per page
+static uint16_t lcd_ui_ticks = 0;           // Updates of current page
+static uint8_t lcd_ui_last[LCD_UI_FIELDS][LCD_UI_VALUE_LEN]; // Values drawn
+
+/* Local functions ---------------------------------------------------*/
+/**********************************************************************
+ * Function: lcd_ui_value_len()
+ * Purpose:  Get size of variable bound to field.
+ * Input:    format Format of field
+ * Returns:  Bytes compared to detect a change, 0 for static text
+ **********************************************************************/
+static uint8_t lcd_ui_value_len(uint8_t format)
+{
+    switch (format)
+    {
+    case LCD_UI_U8:
+        return 1;
+    case LCD_UI_U16:
+    case LCD_UI_S16:
+    case LCD_UI_TENTHS:
+        return 2;
+    case LCD_UI_TIME:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_ui_format()
+ * Purpose:  Format value of field as text.
+ * Input:    buf Buffer of LCD_UI_TEXT_LEN bytes
+ *           field Field copied from flash
+ *           value Copy of bound variable
+ * Returns:  Length of text
+ **********************************************************************/
+static uint8_t lcd_ui_format(char *buf, const lcd_ui_field_t *field,
+                             const uint8_t *value)
+{
+    uint16_t word = value[0] | (value[1] << 8);
+    uint8_t len = 0;
+    char c;
+
+    switch (field->format)
+    {
+    case LCD_UI_TEXT:
+        if (field->value != NULL)
+        {
+            while (len < LCD_UI_TEXT_LEN - 1 &&
+                   (c = pgm_read_byte((const char *)field->value + len)) != '\0')
+            {
+                buf[len++] = c;
+            }
+        }
+        return len;
+    case LCD_UI_U8:
+        return fmt_u8(buf, LCD_UI_TEXT_LEN, value[0], 0);
+    case LCD_UI_U16:
+        return fmt_u16(buf, LCD_UI_TEXT_LEN, word, 0);
+    case LCD_UI_S16:
+        return fmt_s16(buf, LCD_UI_TEXT_LEN, word, 0);
+    case LCD_UI_TENTHS:
+        return fmt_tenths(buf, LCD_UI_TEXT_LEN, word, 0);
+    case LCD_UI_TIME:
+        // Control bits of RTC registers are masked
+        fmt_bcd(&buf[0], value[0] & 0b00111111);
+        buf[2] = ':';
+        fmt_bcd(&buf[3], value[1] & 0b01111111);
+        buf[5] = ':';
+        fmt_bcd(&buf[6], value[2] & 0b01111111);
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_ui_draw()
+ * Purpose:  Draw text of field into framebuffer, aligned and padded to
+ *           its width. Text longer than the field is shown as '#'.
+ * Input:    field Field copied from flash
+ *           value Copy of bound variable
+ * Returns:  none
+ **********************************************************************/
+static void lcd_ui_draw(const lcd_ui_field_t *field, const uint8_t *value)
+{
+    char buf[LCD_UI_TEXT_LEN];
+    uint8_t len = lcd_ui_format(buf, field, value);
+    uint8_t width = field->width;
+    uint8_t i;
+
+    if (width == 0)
+    {
+        width = len;
+    }
+    lcd_fb_gotoxy(field->glyph == LCD_UI_NO_GLYPH ? field->x : field->x + 1,
+                  field->y);
+    if (len > width)
+    {
+        for (i = 0; i < width; i++)
+        {
+            lcd_fb_putc('#');
+        }
+        return;
+    }
+
+    if (field->align == LCD_UI_RIGHT)
+    {
+        for (i = len; i < width; i++)
+        {
+            lcd_fb_putc(' ');
+        }
+    }
+    for (i = 0; i < len; i++)
+    {
+        lcd_fb_putc(buf[i]);
+    }
+    if (field->align != LCD_UI_RIGHT)
+    {
+        for (i = len; i < width; i++)
+        {
+            lcd_fb_putc(' ');
+        }
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_ui_graph()
+ * Purpose:  Draw bar graph or sparkline of field into framebuffer.
+ * Input:    field Field copied from flash
+ * Returns:  none
+ **********************************************************************/
+static void lcd_ui_graph(const lcd_ui_field_t *field)
+{
+    if (field->format == LCD_UI_BAR)
+    {
+        lcd_fb_gotoxy(field->glyph == LCD_UI_NO_GLYPH ? field->x : field->x + 1,
+                      field->y);
+        lcd_graph_bar(field->width, *(const uint16_t *)field->value, field->max);
+    }
+    else
+    {
+        lcd_fb_gotoxy(field->x, field->y);
+        lcd_graph_spark(field->value, field->max, field->glyph);
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_ui_clear()
+ * Purpose:  Fill framebuffer with spaces, the LCD is not cleared.
+ * Returns:  none
+ **********************************************************************/
+static void lcd_ui_clear(void)
+{
+    uint8_t x, y;
+
+    for (y = 0; y < LCD_LINES; y++)
+    {
+        lcd_fb_gotoxy(0, y);
+        for (x = 0; x < LCD_DISP_LENGTH; x++)
+        {
+            lcd_fb_putc(' ');
+        }
+    }
+}
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: lcd_ui_init()
+ * Purpose:  Set table of pages, first page is shown at next update.
+ * Input:    pages Table of pages in flash
+ *           count Number of pages
+ *           period Updates a page is shown, 0 - No rotation
+ * Returns:  none
+ **********************************************************************/
+void lcd_ui_init(const lcd_ui_page_t *pages, uint8_t count, uint16_t period)
+{
+    lcd_ui_pages = pages;
+    lcd_ui_count = count;
+    lcd_ui_period = period;
+    lcd_ui_show(0);
+}
+
+/**********************************************************************
+ * Function: lcd_ui_show()
+ * Purpose:  Select page drawn at next update.
+ * Input:    page Index of page, wraps around
+ * Returns:  none
+ **********************************************************************/
+void lcd_ui_show(uint8_t page)
+{
+    lcd_ui_page = (page < lcd_ui_count) ? page : 0;
+    lcd_ui_ticks = 0;
+    lcd_ui_drawn = 0;
+}
+
+/**********************************************************************
+ * Function: lcd_ui_next()
+ * Purpose:  Select next page, the first one follows the last one.
+ * Returns:  none
+ **********************************************************************/
+void lcd_ui_next(void)
+{
+    lcd_ui_show(lcd_ui_page + 1);
+}
+
+/**********************************************************************
+ * Function: lcd_ui_refresh()
+ * Purpose:  Draw all fields of current page at next update.
+ * Returns:  none
+ **********************************************************************/
+void lcd_ui_refresh(void)
+{
+    lcd_ui_drawn = 0;
+}
+
+/**********************************************************************
+ * Function: lcd_ui_update()
+ * Purpose:  Rotate pages, then draw glyphs and graphs of all fields
+ *           and text of fields whose bound variables changed. A page
+ *           just shown is drawn completely on a cleared framebuffer.
+ * Returns:  none
+ **********************************************************************/
+void lcd_ui_update(void)
+{
+    lcd_ui_page_t page;
+    lcd_ui_field_t field;
+    uint8_t value[LCD_UI_VALUE_LEN];
+    uint8_t len;
+    uint8_t i;
+
+    if (lcd_ui_count == 0)
+    {
+        return;
+    }
+    if (lcd_ui_period != 0 && ++lcd_ui_ticks >= lcd_ui_period)
+    {
+        lcd_ui_next();
+    }
+
+    memcpy_P(&page, &lcd_ui_pages[lcd_ui_page], sizeof(page));
+    if (!lcd_ui_drawn)
+    {
+        lcd_ui_clear();
+    }
+    for (i = 0; i < page.count; i++)
+    {
+        memcpy_P(&field, &page.fields[i], sizeof(field));
+
+        // Glyphs are requested every time, so they stay in CGRAM
+        if (field.glyph != LCD_UI_NO_GLYPH && field.format != LCD_UI_SPARK)
+        {
+            lcd_fb_gotoxy(field.x, field.y);
+            lcd_fb_putc(lcd_glyph(field.glyph));
+        }
+        if (field.format == LCD_UI_BAR || field.format == LCD_UI_SPARK)
+        {
+            lcd_ui_graph(&field);
+            continue;
+        }
+
+        len = lcd_ui_value_len(field.format);
+        memset(value, 0, sizeof(value));
+        if (len != 0)
+        {
+            memcpy(value, field.value, len);
+        }
+        if (lcd_ui_drawn && i < LCD_UI_FIELDS)
+        {
+            if (memcmp(value, lcd_ui_last[i], len) == 0)
+            {
+                continue;   /* Unchanged, static text included */
+            }
+        }
+        if (i < LCD_UI_FIELDS)
+        {
+            memcpy(lcd_ui_last[i], value, len);
+        }
+        lcd_ui_draw(&field, value);
+    }
+    lcd_ui_drawn = 1;
+}
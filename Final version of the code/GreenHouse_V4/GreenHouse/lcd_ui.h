@@ -0,0 +1,138 @@
+#ifndef LCD_UI_H
+# define LCD_UI_H
+
+/***********************************************************************
+ *
+ * Screen layout engine for HD44780 LCD for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/**
+ * @file
+ * @defgroup lcd_ui LCD Screen Layout <lcd_ui.h>
+ * @code #include "lcd_ui.h" @endcode
+ *
+ * @brief Pages of fields described in flash and bound to variables.
+ *
+ * A page is a table of fields in program memory. Each field has a
+ * position, a width, a format, an alignment, an optional glyph drawn
+ * left of it and a pointer to the variable it shows. lcd_ui_update()
+ * draws the whole page into the framebuffer when it is shown, then
+ * formats only the fields whose variables changed since the previous
+ * call. Labels and units are LCD_UI_TEXT fields, drawn once per page.
+ * Bar graphs and sparklines are drawn on every update, which keeps
+ * their glyphs in CGRAM, and cost LCD writes only when they change.
+ *
+ * Pages can be rotated every given number of updates. The framebuffer
+ * sends only cells that differ between two pages, so the same labels
+ * on the same positions cost no LCD writes.
+ *
+ * lcd_ui_update() reads the bound variables without disabling
+ * interrupts, so call it from the context that writes them.
+ * @{
+ */
+
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "lcd_fb.h"
+#include "lcd_glyph.h"
+#include "lcd_graph.h"
+
+
+/* Defines -----------------------------------------------------------*/
+#ifndef LCD_UI_FIELDS
+# define LCD_UI_FIELDS 12   /**< @brief Fields of a page checked for changes, others are drawn every update */
+#endif
+
+#define LCD_UI_NO_GLYPH 0xff    /**< @brief Field without glyph */
+
+/** @brief Format of field */
+typedef enum {
+    LCD_UI_TEXT,            /**< @brief Terminated string in flash, drawn when page is shown, may be NULL */
+    LCD_UI_U8,              /**< @brief uint8_t in decimal */
+    LCD_UI_U16,             /**< @brief uint16_t in decimal */
+    LCD_UI_S16,             /**< @brief int16_t in decimal */
+    LCD_UI_TENTHS,          /**< @brief int16_t in tenths as "-xx.x" */
+    LCD_UI_TIME,            /**< @brief Hours, minutes, seconds in BCD as "hh:mm:ss" */
+    LCD_UI_BAR,             /**< @brief uint16_t as bar graph of width cells, full at max */
+    LCD_UI_SPARK            /**< @brief lcd_graph_hist_t as sparkline, full at max, glyph is first RAM glyph */
+} lcd_ui_format_t;
+
+/** @brief Alignment of text in field */
+typedef enum {
+    LCD_UI_LEFT,            /**< @brief Padded by trailing spaces */
+    LCD_UI_RIGHT            /**< @brief Padded by leading spaces */
+} lcd_ui_align_t;
+
+/** @brief Field of page, stored in flash */
+typedef struct {
+    uint8_t x;              /**< @brief Column of glyph or text */
+    uint8_t y;              /**< @brief Line */
+    uint8_t width;          /**< @brief Cells of text, 0 for length of LCD_UI_TEXT */
+    uint8_t format;         /**< @brief lcd_ui_format_t */
+    uint8_t align;          /**< @brief lcd_ui_align_t */
+    uint8_t glyph;          /**< @brief lcd_glyph_t drawn at x, text follows, or LCD_UI_NO_GLYPH */
+    const void *value;      /**< @brief Bound variable, text in flash for LCD_UI_TEXT */
+    uint16_t max;           /**< @brief Full scale of LCD_UI_BAR and LCD_UI_SPARK */
+} lcd_ui_field_t;
+
+/** @brief Page, stored in flash */
+typedef struct {
+    const lcd_ui_field_t *fields;   /**< @brief Fields in flash */
+    uint8_t count;                  /**< @brief Number of fields */
+} lcd_ui_page_t;
+
+
+/* Function prototypes -----------------------------------------------*/
+/**
+ * @name Functions
+ */
+
+/**
+ * @brief  Set pages and show the first one at the next update.
+ * @param  pages Table of pages in flash
+ * @param  count Number of pages
+ * @param  period Updates a page is shown, 0 disables rotation
+ * @return none
+ * @note   Call after lcd_fb_init().
+ */
+void lcd_ui_init(const lcd_ui_page_t *pages, uint8_t count, uint16_t period);
+
+
+/**
+ * @brief  Show page at the next update and restart rotation period.
+ * @param  page Index of page
+ * @return none
+ */
+void lcd_ui_show(uint8_t page);
+
+
+/**
+ * @brief  Show next page at the next update.
+ * @return none
+ */
+void lcd_ui_next(void);
+
+
+/**
+ * @brief  Draw all fields of current page again at the next update.
+ * @return none
+ */
+void lcd_ui_refresh(void);
+
+
+/**
+ * @brief  Rotate pages and draw changed fields into the framebuffer.
+ * @return none
+ * @note   Call lcd_fb_flush() afterwards to send the changes.
+ */
+void lcd_ui_update(void);
+
+/** @} */
+
+#endif
@@ -10,6 +10,9 @@
 #define VENT_PIN PD3		// Ventilation relay pin
 #define SPRNKL_PIN PD2		// Sprinkler relay pin
 #define BULB_PIN PB2		// Light relay pin
+#define RTC_ADDRESS 0x68	// TWI address of RTC DS1307
+#define LOG_LEN 16			// Records of scan cycles kept for download, 4 min
+#define LCD_PAGE_TICKS 150	// LCD pages rotate every 33ms x 150 = 5s
 
 #ifndef F_CPU
 # define F_CPU 16000000  // CPU frequency in Hz required for UART_BAUD_SELECT
@@ -21,11 +24,24 @@
 #include <stdlib.h>         // C library. Needed for conversion function
 #include <string.h>			// C library. Needed for string connections
 #include <util/delay.h>     // Functions for busy-wait delay loops
+#include <util/atomic.h>    // Blocks executed with interrupts disabled
 #include "gpio.h"			// GPIO library for AVR-GCC
 #include "uart.h"           // Peter Fleury's UART library
 #include "timer.h"          // Timer library for AVR-GCC
 #include "twi.h"            // TWI library for AVR-GCC
+#include "dht12.h"          // DHT12 sensor array library
+#include "regmap.h"         // Register map served to TWI master
+#include "telemetry.h"      // Binary telemetry records
+#include "settings.h"       // Thresholds and calibration changeable at run time
+#include "console.h"        // UART command line
+#include "fmt.h"            // Integer to text without division
+#ifdef BENCH
+#include "bench.h"          // Cycle counts of fmt and itoa
+#endif
 #include "lcd.h"            // Peter Fleury's LCD library
+#include "lcd_fb.h"         // LCD contents in RAM, only changes are sent
+#include "lcd_glyph.h"      // Custom characters in flash, cached in CGRAM
+#include "lcd_ui.h"         // LCD pages of fields bound to variables
 
 /* Variables ---------------------------------------------------------*/
 typedef enum {              // FSM declaration
@@ -41,33 +57,140 @@ typedef enum {              // FSM declaration
 
 uint16_t adc_moist = 0;		// ADC Soil Moisture level value
 uint16_t adc_light = 400;		// ADC Light level value
+static int16_t temperature = 0;		// Average temperature in 0.1 C
+static uint16_t light_level = 0;	// Light level in % of settings.day_val
+static lcd_graph_hist_t moist_hist;	// Moisture of last scan cycles, 4 min
+static lcd_graph_hist_t light_hist;	// Light level of last scan cycles, 4 min
+
+static telemetry_t telemetry;	// Telemetry record collected during one scan cycle
+static telemetry_t log_recs[LOG_LEN];	// Last records, oldest is overwritten
+static uint8_t log_next = 0;		// Index of record written next
+static uint8_t log_count = 0;		// Number of valid records
+static dht12_stats_t climate;		// Statistics of the last complete DHT12 scan
+
+// UART speeds selectable by command "baud", normal or double speed mode chosen automatically
+static const uint32_t uart_rates[] = {9600, 115200, 250000, 500000, 1000000};
+static const unsigned int uart_bauds[] = {
+	UART_BAUD_SELECT_AUTO(9600UL, F_CPU),
+	UART_BAUD_SELECT_AUTO(115200UL, F_CPU),
+	UART_BAUD_SELECT_AUTO(250000UL, F_CPU),
+	UART_BAUD_SELECT_AUTO(500000UL, F_CPU),
+	UART_BAUD_SELECT_AUTO(1000000UL, F_CPU)
+};
+UART_BAUD_CHECK(9600UL, F_CPU);		// Compilation fails if the error exceeds UART_BAUD_MAX_ERROR
+UART_BAUD_CHECK(115200UL, F_CPU);
+UART_BAUD_CHECK(250000UL, F_CPU);
+UART_BAUD_CHECK(500000UL, F_CPU);
+UART_BAUD_CHECK(1000000UL, F_CPU);
+static unsigned int uart_baud = UART_BAUD_SELECT_AUTO(UART_BAUD, F_CPU);	// Current speed
+
+// TWI transaction, processed in the background by the TWI interrupt
+static uint8_t rtc_data[7];		// Seconds, minutes, hours, day, date, month and year in BCD
+static twi_trans_t rtc_trans = {
+	.address = RTC_ADDRESS,
+	.reg_len = 1, .reg = 0x00,
+	.rx_buf = rtc_data, .rx_len = sizeof(rtc_data)
+};
+
+void uart_puts_twi_devices(uint8_t all);	// Defined below, also used at start-up
+void uart_switch_baud(unsigned int baudrate);
+#ifdef TWI_TRACE
+void uart_put_twi_trace();
+#endif
+
+// Console commands, defined below
+void cmd_get(uint8_t argc, char *argv[]);
+void cmd_set(uint8_t argc, char *argv[]);
+void cmd_time(uint8_t argc, char *argv[]);
+void cmd_stats(uint8_t argc, char *argv[]);
+void cmd_log(uint8_t argc, char *argv[]);
+void cmd_mode(uint8_t argc, char *argv[]);
+void cmd_baud(uint8_t argc, char *argv[]);
+#ifdef TWI_TRACE
+void cmd_trace(uint8_t argc, char *argv[]);
+#endif
+
+// Names and help texts in flash, listed by "help"
+static const char cmd_get_name[] PROGMEM = "get";
+static const char cmd_get_help[] PROGMEM = "[name] - show settings";
+static const char cmd_set_name[] PROGMEM = "set";
+static const char cmd_set_help[] PROGMEM = "name value - change setting";
+static const char cmd_time_name[] PROGMEM = "time";
+static const char cmd_time_help[] PROGMEM = "hh:mm:ss - set RTC";
+static const char cmd_stats_name[] PROGMEM = "stats";
+static const char cmd_stats_help[] PROGMEM = "- show sensor and bus statistics";
+static const char cmd_log_name[] PROGMEM = "log";
+static const char cmd_log_help[] PROGMEM = "- download records of last scan cycles";
+static const char cmd_mode_name[] PROGMEM = "mode";
+static const char cmd_mode_help[] PROGMEM = "text|binary - select telemetry format";
+static const char cmd_baud_name[] PROGMEM = "baud";
+static const char cmd_baud_help[] PROGMEM = "rate - change UART speed, confirm by 'y'";
+#ifdef TWI_TRACE
+static const char cmd_trace_name[] PROGMEM = "trace";
+static const char cmd_trace_help[] PROGMEM = "- dump TWI trace in binary";
+#endif
+
+static const console_cmd_t commands[] PROGMEM = {
+	{cmd_get_name, cmd_get, cmd_get_help},
+	{cmd_set_name, cmd_set, cmd_set_help},
+	{cmd_time_name, cmd_time, cmd_time_help},
+	{cmd_stats_name, cmd_stats, cmd_stats_help},
+	{cmd_log_name, cmd_log, cmd_log_help},
+	{cmd_mode_name, cmd_mode, cmd_mode_help},
+	{cmd_baud_name, cmd_baud, cmd_baud_help},
+#ifdef TWI_TRACE
+	{cmd_trace_name, cmd_trace, cmd_trace_help},
+#endif
+};
+
+// LCD pages, fields are redrawn when their variables change
+static const char lcd_deg_c[] PROGMEM = "\xdf" "C";
+static const char lcd_percent[] PROGMEM = "%";
+static const char lcd_dash[] PROGMEM = "-";
+static const char lcd_rh[] PROGMEM = "RH";
+static const char lcd_4min[] PROGMEM = "4 min";
+
+static const lcd_ui_field_t lcd_main_fields[] PROGMEM = {
+	{0, 0, 8, LCD_UI_TIME, LCD_UI_LEFT, LCD_UI_NO_GLYPH, &regmap.hours},	// "hh:mm:ss"
+	{9, 0, 4, LCD_UI_TENTHS, LCD_UI_RIGHT, LCD_GLYPH_THERMO, &temperature},
+	{14, 0, 0, LCD_UI_TEXT, LCD_UI_LEFT, LCD_UI_NO_GLYPH, lcd_deg_c},
+	{0, 1, 3, LCD_UI_U16, LCD_UI_RIGHT, LCD_GLYPH_DROP, &adc_moist},
+	{4, 1, 0, LCD_UI_TEXT, LCD_UI_LEFT, LCD_UI_NO_GLYPH, lcd_percent},
+	{10, 1, 4, LCD_UI_U16, LCD_UI_RIGHT, LCD_GLYPH_BULB, &light_level},
+	{15, 1, 0, LCD_UI_TEXT, LCD_UI_LEFT, LCD_UI_NO_GLYPH, lcd_percent}
+};
+
+static const lcd_ui_field_t lcd_climate_fields[] PROGMEM = {
+	{0, 0, 5, LCD_UI_TENTHS, LCD_UI_RIGHT, LCD_GLYPH_THERMO, &climate.temp_min},	// "min-maxC"
+	{6, 0, 0, LCD_UI_TEXT, LCD_UI_LEFT, LCD_UI_NO_GLYPH, lcd_dash},
+	{7, 0, 5, LCD_UI_TENTHS, LCD_UI_RIGHT, LCD_UI_NO_GLYPH, &climate.temp_max},
+	{12, 0, 0, LCD_UI_TEXT, LCD_UI_LEFT, LCD_UI_NO_GLYPH, lcd_deg_c},
+	{0, 1, 0, LCD_UI_TEXT, LCD_UI_LEFT, LCD_UI_NO_GLYPH, lcd_rh},
+	{2, 1, 5, LCD_UI_TENTHS, LCD_UI_RIGHT, LCD_UI_NO_GLYPH, &climate.humid_avg},
+	{7, 1, 0, LCD_UI_TEXT, LCD_UI_LEFT, LCD_UI_NO_GLYPH, lcd_percent}
+};
+
+static const lcd_ui_field_t lcd_moist_fields[] PROGMEM = {
+	{0, 0, 10, LCD_UI_BAR, LCD_UI_LEFT, LCD_GLYPH_DROP, &adc_moist, 100},	// Bar of 50 steps
+	{12, 0, 3, LCD_UI_U16, LCD_UI_RIGHT, LCD_UI_NO_GLYPH, &adc_moist},
+	{15, 0, 0, LCD_UI_TEXT, LCD_UI_LEFT, LCD_UI_NO_GLYPH, lcd_percent},
+	{0, 1, 0, LCD_UI_TEXT, LCD_UI_LEFT, LCD_UI_NO_GLYPH, lcd_4min},
+	{6, 1, 0, LCD_UI_SPARK, LCD_UI_LEFT, LCD_GLYPH_RAM0, &moist_hist, 100}	// 16 scan cycles
+};
 
-// Custom character definition
-uint32_t customChar[24] = {
-	0b00000, // First line of the humidity character
-	0b00100,
-	0b01110,
-	0b11111,
-	0b11111,
-	0b11111,
-	0b01110,
-	0b00000, // Last line of the humidity character
-	0b00100, // First line of the temperature character
-	0b01010,
-	0b01110,
-	0b01110,
-	0b01110,
-	0b10101,
-	0b11111,
-	0b01110,  // Last line of the temperature character
-	0b01110,  // First line of the light character
-	0b10001,
-	0b10001,
-	0b10101,
-	0b10101,
-	0b01110,
-	0b01110,
-	0b00100   // Last line of the light character
+static const lcd_ui_field_t lcd_light_fields[] PROGMEM = {
+	{0, 0, 10, LCD_UI_BAR, LCD_UI_LEFT, LCD_GLYPH_BULB, &light_level, 100},
+	{12, 0, 3, LCD_UI_U16, LCD_UI_RIGHT, LCD_UI_NO_GLYPH, &light_level},
+	{15, 0, 0, LCD_UI_TEXT, LCD_UI_LEFT, LCD_UI_NO_GLYPH, lcd_percent},
+	{0, 1, 0, LCD_UI_TEXT, LCD_UI_LEFT, LCD_UI_NO_GLYPH, lcd_4min},
+	{6, 1, 0, LCD_UI_SPARK, LCD_UI_LEFT, LCD_GLYPH_RAM0, &light_hist, 100}
+};
+
+static const lcd_ui_page_t lcd_pages[] PROGMEM = {
+	{lcd_main_fields, sizeof(lcd_main_fields) / sizeof(lcd_main_fields[0])},
+	{lcd_climate_fields, sizeof(lcd_climate_fields) / sizeof(lcd_climate_fields[0])},
+	{lcd_moist_fields, sizeof(lcd_moist_fields) / sizeof(lcd_moist_fields[0])},
+	{lcd_light_fields, sizeof(lcd_light_fields) / sizeof(lcd_light_fields[0])}
 };
 
 int main(void)
@@ -80,69 +203,83 @@ int main(void)
 	GPIO_write_low(&PORTD, SPRNKL_PIN);
 	GPIO_write_low(&PORTB, BULB_PIN);
 	
-	// LCD Initialization
-	lcd_init(LCD_DISP_ON);
-	
     // Initialize I2C (TWI)
     twi_init();
+	twi_enumerate();			// Build registry of devices on the main bus
+	if (twi_dev_present(RTC_ADDRESS)) {
+		twi_dev_probe(RTC_ADDRESS, 100);	// DS1307 supports standard mode only
+	}
+	dht12_init();				// DHT12 array, probes speed of a sensor on the main bus
+	
+	// LCD Initialization, after TWI when the display has an I2C backpack
+#if LCD_IO_MODE == LCD_IO_I2C
+	twi_dev_probe(LCD_I2C_ADDRESS, 100);	// PCF8574 supports standard mode only
+#elif LCD_IO_MODE == LCD_IO_SSD1306
+	twi_dev_probe(LCD_SSD1306_ADDRESS, 400);	// SSD1306 supports fast mode
+#endif
+	lcd_init(LCD_DISP_ON);
+	
+	// Serve measured values and thresholds to a supervisory TWI master
+	regmap.temp_on = settings.temp_on;
+	regmap.moist_on = settings.moist_on;
+	regmap.light_on = settings.light_on;
+	regmap_init();
 
 	// Initialize RTC time
-	if (twi_start((0x68<<1) + TWI_WRITE) == 0) {	// Device is accessible
-		twi_write(0x00);							// Sending message to slave
-		twi_write(0b00000000);
-		twi_write(0b01000101);
-		twi_write(0b00000010);
-		twi_write(0b00000000);
-		twi_write(0b00000000);
-		twi_write(0b00000000);
-		twi_write(0b00000000);
-		twi_write(0b00000000);
+	static const uint8_t rtc_init[] = {
+		0b00000000,		// Seconds, starting at register 0x00
+		0b01000101,
+		0b00000010,
+		0b00000000,
+		0b00000000,
+		0b00000000,
+		0b00000000,
+		0b00000000
+	};
+	if (twi_dev_present(RTC_ADDRESS)) {
+		twi_write_regs(RTC_ADDRESS, 0x00, rtc_init, sizeof(rtc_init));
 	}
 
-	// Import customChar matrix into a LCD memory
-    lcd_command(1 << LCD_CGRAM); // Set pointer to beginning of CGRAM memory
-    for (uint8_t i = 0; i < 24; i++)
-    {
-	    // Store all new chars to memory line by line
-	    lcd_data(customChar[i]);
-    }
-    lcd_command(1 << LCD_DDRAM); // Set DDRAM address
-	
-	// Create basic layout on the LCD screen
-    lcd_gotoxy(0, 0);
-    lcd_puts("00:00:00");
-    lcd_gotoxy(10, 0);
-    lcd_putc(1);		// Display thermometer character
-	lcd_putc('0');
-	lcd_putc(0xdf);
-	lcd_putc('C');
-    lcd_gotoxy(0, 1);
-    lcd_putc(0);		// Display moisture character
-    lcd_gotoxy(10, 1);
-    lcd_putc(2);		// Display light level character
-	lcd_gotoxy(14, 1);
+	// Create basic layout on the LCD screen, icons are uploaded to CGRAM on first use
+	lcd_glyph_init();
+	lcd_fb_init();
+	lcd_ui_init(lcd_pages, sizeof(lcd_pages) / sizeof(lcd_pages[0]), LCD_PAGE_TICKS);
+	lcd_ui_update();
+	lcd_fb_flush();
 	
 	// Setup an ADC conversion
 	ADCSRA |= (1<<ADEN);	// Enable ADC module
 	ADCSRA |= (1<<ADPS0); ADCSRA |= (1<<ADPS1); ADCSRA |= (1<<ADPS2);	// Set clock prescaler to 128
 	
-	// Initialize UART to asynchronous, 8N1, 9600
-	uart_init(UART_BAUD_SELECT(9600, F_CPU));
+	// Initialize UART to asynchronous, 8N1, UART_BAUD
+	uart_init(uart_baud);
 	uart_puts("UART Enabled.\r\n");
+	console_init(commands, sizeof(commands) / sizeof(commands[0]));
 	
     // Configure 8-bit Timer/Counter0 for Scan cycle
     // Set the overflow prescaler to 4 sec and enable interrupt
     TIM1_overflow_33ms();
     TIM1_overflow_interrupt_enable();
 	
+	// Configure 8-bit Timer/Counter2 to send queued LCD output, one nibble per overflow
+	TIM2_overflow_128us();
+	TIM2_overflow_interrupt_enable();
+	
 	// Enable interrupts by setting the global interrupt mask
 	sei();
+	uart_puts_twi_devices(1);	// Report devices found on the main bus
+#ifdef BENCH
+	bench_fmt();				// Compare formatting with itoa
+	bench_lcd();				// Compare LCD delays with busy flag
+	lcd_fb_invalidate();		// Restore line overwritten by benchmark
+#endif
 
     // Infinite loop
     while (1) 
     {
-        /* Empty loop. All subsequent operations are performed exclusively 
-         * inside interrupt service routines ISRs */
+        /* All subsequent operations are performed exclusively inside
+         * interrupt service routines ISRs, the loop only serves UART commands */
+		console_poll();
     }
 	
     // Function will never reach this point
@@ -169,54 +306,362 @@ unsigned int readADC1()
 	return ADC;
 }
 
+// Send debug text via UART, only in human-readable telemetry mode
+void log_puts(const char *s)
+{
+	if (telemetry_mode() == TELEMETRY_TEXT) {
+		uart_puts(s);
+	}
+}
+
+// Send minimum, average and maximum of values in tenths via UART
+void uart_puts_min_avg_max(const char *name, int16_t min, int16_t avg, int16_t max)
+{
+	char str[FMT_TENTHS_LEN];
+	
+	uart_puts(name);
+	uart_puts(" min/avg/max: ");
+	fmt_tenths(str, sizeof(str), min, 0);
+	uart_puts(str);
+	uart_puts("/");
+	fmt_tenths(str, sizeof(str), avg, 0);
+	uart_puts(str);
+	uart_puts("/");
+	fmt_tenths(str, sizeof(str), max, 0);
+	uart_puts(str);
+	uart_puts("\r\n");
+}
+
+#ifdef TWI_TRACE
+// Send TWI trace in binary: 'T', number of entries n, number of lost entries,
+// then n times start (2 B), end (2 B), address, length and status; 16-bit values LSB first
+void uart_put_twi_trace()
+{
+	twi_trace_t entry[TWI_TRACE_SIZE];
+	uint8_t n = 0;
+	uint8_t lost = twi_trace_lost();
+	
+	while (n < TWI_TRACE_SIZE && twi_trace_read(&entry[n])) {
+		n++;
+	}
+	uart_putc('T');
+	uart_putc(n);
+	uart_putc(lost);
+	for (uint8_t i = 0; i < n; i++) {
+		uart_putc(entry[i].start & 0xff);
+		uart_putc(entry[i].start >> 8);
+		uart_putc(entry[i].end & 0xff);
+		uart_putc(entry[i].end >> 8);
+		uart_putc(entry[i].address);
+		uart_putc(entry[i].len);
+		uart_putc(entry[i].status);
+	}
+}
+#endif
+
+// Change UART speed, keep it only if the host answers 'y' at the new speed within 3 s
+void uart_switch_baud(unsigned int baudrate)
+{
+	uart_puts("Switching baud rate, confirm by 'y'\r\n");
+	uart_set_baudrate(baudrate);		// Waits until the message is sent
+	while (uart_getc() != UART_NO_DATA);	// Discard bytes garbled by the switch
+	
+	for (uint16_t i = 0; i < 300; i++) {
+		_delay_ms(10);
+		if (uart_getc() == 'y') {		// No error flags in the high byte
+			uart_baud = baudrate;
+			uart_puts("Baud rate confirmed\r\n");
+			return;
+		}
+	}
+	uart_set_baudrate(uart_baud);		// No answer, return to the previous speed
+	uart_puts("Baud rate not confirmed\r\n");
+}
+
+// Parse decimal number from whole string, return 1 if it is not a number
+uint8_t parse_int(const char *str, int16_t *value)
+{
+	char *end;
+	long n = strtol(str, &end, 10);
+	
+	if (end == str || *end != '\0' || n < INT16_MIN || n > INT16_MAX) {
+		return 1;
+	}
+	*value = n;
+	return 0;
+}
+
+// Send one setting as "name = value"
+void uart_puts_setting(uint8_t index)
+{
+	char str[FMT_S16_LEN];
+	
+	uart_puts_p(settings_name(index));
+	uart_puts(" = ");
+	fmt_s16(str, sizeof(str), settings_get(index), 0);
+	uart_puts(str);
+	uart_puts("\r\n");
+}
+
+// Console: get [name]
+void cmd_get(uint8_t argc, char *argv[])
+{
+	int8_t index;
+	
+	if (argc < 2) {
+		for (uint8_t i = 0; settings_name(i) != NULL; i++) {
+			uart_puts_setting(i);
+		}
+	}
+	else if ((index = settings_find(argv[1])) < 0) {
+		uart_puts("Unknown setting\r\n");
+	}
+	else {
+		uart_puts_setting(index);
+	}
+}
+
+// Console: set name value
+void cmd_set(uint8_t argc, char *argv[])
+{
+	int8_t index;
+	int16_t value;
+	
+	if (argc != 3 || parse_int(argv[2], &value) != 0) {
+		uart_puts("Usage: set name value\r\n");
+	}
+	else if ((index = settings_find(argv[1])) < 0) {
+		uart_puts("Unknown setting\r\n");
+	}
+	else if (settings_set(index, value) != 0) {
+		uart_puts("Value out of range\r\n");
+	}
+	else {
+		uart_puts_setting(index);
+	}
+}
+
+// Console: time hh:mm:ss, written to RTC in BCD with the clock running
+void cmd_time(uint8_t argc, char *argv[])
+{
+	static const uint8_t limit[3] = {24, 60, 60};
+	uint8_t time[3];		// Hours, minutes, seconds
+	uint8_t regs[3];		// Seconds, minutes, hours in BCD
+	const char *s = (argc == 2) ? argv[1] : "";
+	
+	for (uint8_t i = 0; i < 3; i++) {
+		if (s[0] < '0' || s[0] > '9' || s[1] < '0' || s[1] > '9' || s[2] != (i < 2 ? ':' : '\0')) {
+			uart_puts("Usage: time hh:mm:ss\r\n");
+			return;
+		}
+		time[i] = (s[0] - '0') * 10 + (s[1] - '0');
+		if (time[i] >= limit[i]) {
+			uart_puts("Time out of range\r\n");
+			return;
+		}
+		regs[2 - i] = ((s[0] - '0') << 4) | (s[1] - '0');
+		s += 3;
+	}
+	if (!twi_dev_present(RTC_ADDRESS)) {
+		uart_puts("RTC not present\r\n");
+	}
+	else if (twi_write_regs(RTC_ADDRESS, 0x00, regs, sizeof(regs)) != TWI_OK) {
+		uart_puts("RTC write failed\r\n");
+	}
+	else {
+		uart_puts("Time set\r\n");
+	}
+}
+
+// Console: stats
+void cmd_stats(uint8_t argc, char *argv[])
+{
+	dht12_stats_t stats;
+	char str[FMT_U16_LEN];
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		stats = climate;		// Written by timer interrupt
+	}
+	uart_puts("DHT12 sensors read: ");
+	fmt_u8(str, sizeof(str), stats.count, 0);
+	uart_puts(str);
+	uart_puts("\r\n");
+	if (stats.count != 0) {
+		uart_puts_min_avg_max("Temperature", stats.temp_min, stats.temp_avg, stats.temp_max);
+		uart_puts_min_avg_max("Humidity", stats.humid_min, stats.humid_avg, stats.humid_max);
+	}
+	uart_puts_twi_devices(1);
+	uart_puts("UART bytes dropped: ");
+	fmt_u16(str, sizeof(str), uart_tx_overflows(), 0);
+	uart_puts(str);
+	uart_puts("\r\n");
+}
+
+// Console: log, oldest record first; text lines or COBS frames depending on mode
+void cmd_log(uint8_t argc, char *argv[])
+{
+	telemetry_t rec;
+	uint8_t count;
+	uint8_t first;
+	uint8_t busy;
+	char str[FMT_TENTHS_LEN];
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		count = log_count;
+		first = (log_next + LOG_LEN - log_count) % LOG_LEN;
+	}
+	for (uint8_t i = 0; i < count; i++) {
+		// Timer interrupt may overwrite the oldest records meanwhile
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			rec = log_recs[(first + i) % LOG_LEN];
+		}
+		if (telemetry_mode() == TELEMETRY_BINARY) {
+			// Other frames are sent by timer interrupt, keep it off the ring, retry until there is space
+			do {
+				ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+					busy = telemetry_send(&rec);
+				}
+			} while (busy);
+			continue;
+		}
+		fmt_bcd(str, rec.hours & 0b00111111);
+		uart_puts(str);
+		uart_puts(":");
+		fmt_bcd(str, rec.minutes & 0b01111111);
+		uart_puts(str);
+		uart_puts(":");
+		fmt_bcd(str, rec.seconds & 0b01111111);
+		uart_puts(str);
+		uart_puts(" temp ");
+		fmt_tenths(str, sizeof(str), rec.temp, 0);
+		uart_puts(str);
+		uart_puts(" moist ");
+		fmt_u16(str, sizeof(str), rec.adc_moist, 0);
+		uart_puts(str);
+		uart_puts(" light ");
+		fmt_u16(str, sizeof(str), rec.adc_light, 0);
+		uart_puts(str);
+		uart_puts(" relays ");
+		fmt_u8(str, sizeof(str), rec.relays, 0);
+		uart_puts(str);
+		uart_puts("\r\n");
+	}
+}
+
+// Console: mode text|binary
+void cmd_mode(uint8_t argc, char *argv[])
+{
+	if (argc == 2 && strcmp(argv[1], "text") == 0) {
+		telemetry_set_mode(TELEMETRY_TEXT);		// Human-readable text
+	}
+	else if (argc == 2 && strcmp(argv[1], "binary") == 0) {
+		telemetry_set_mode(TELEMETRY_BINARY);	// COBS framed records
+	}
+	else {
+		uart_puts("Usage: mode text|binary\r\n");
+	}
+}
+
+// Console: baud rate
+void cmd_baud(uint8_t argc, char *argv[])
+{
+	uint32_t rate = (argc == 2) ? strtoul(argv[1], NULL, 10) : 0;
+	
+	for (uint8_t i = 0; i < sizeof(uart_rates) / sizeof(uart_rates[0]); i++) {
+		if (uart_rates[i] == rate) {
+			uart_switch_baud(uart_bauds[i]);
+			return;
+		}
+	}
+	uart_puts("Usage: baud 9600|115200|250000|500000|1000000\r\n");
+}
+
+#ifdef TWI_TRACE
+// Console: trace
+void cmd_trace(uint8_t argc, char *argv[])
+{
+	uart_put_twi_trace();
+}
+#endif
+
+// Send registry of TWI slaves via UART, unless all is set only when presence or error counters have changed
+void uart_puts_twi_devices(uint8_t all)
+{
+	static uint16_t reported = 0xffff;	// Sum of counters sent last time
+	static uint8_t reported_present = 0;	// Presence of entries sent last time
+	uint16_t sum = 0;
+	uint8_t present = 0;
+	const twi_dev_t *dev;
+	char str[FMT_U16_LEN];
+	
+	for (uint8_t i = 0; (dev = twi_dev(i)) != NULL; i++) {
+		sum += dev->errors;
+		if (dev->flags & TWI_DEV_PRESENT) {
+			present |= 1 << i;
+		}
+	}
+	if (!all && sum == reported && present == reported_present) {
+		return;
+	}
+	reported = sum;
+	reported_present = present;
+	
+	for (uint8_t i = 0; (dev = twi_dev(i)) != NULL; i++) {
+		uart_puts("TWI 0x");
+		itoa(dev->address, str, 16);
+		uart_puts(str);
+		uart_puts((dev->flags & TWI_DEV_PRESENT) ? " present" : " absent");
+		if (dev->flags & TWI_DEV_MUX) {
+			uart_puts(" (mux)");
+		}
+		uart_puts(", errors: ");
+		fmt_u16(str, sizeof(str), dev->errors, 0);
+		uart_puts(str);
+		uart_puts("\r\n");
+	}
+}
+
+ISR(TIMER2_OVF_vect)
+{
+	lcd_tick();		// LCD_TICK_US matches the overflow period
+}
+
 ISR(TIMER1_OVF_vect)
 {
 	// Base Variables
 	static state_t state = STATE_IDLE;
 	static uint16_t counter = 455;
-	static uint8_t err = 0;
 	
 	// DHT12 Variables
-	static uint8_t temperature = 0;
-	char temperature1[] = "";
-	char temperature2[] = "";
-	
-	// RTC DS1307 variables
-	static uint8_t seconds = 0;
-	static uint8_t seconds_1 = 0;	// First digit of seconds
-	static uint8_t seconds_2 = 0;	// Second digit of seconds
-	static uint8_t minutes = 0;
-	static uint8_t minutes_1 = 0;	// First digit of minutes
-	static uint8_t minutes_2 = 0;	// Second digit of minutes
-	static uint8_t hours = 0;
-	static uint8_t hours_1 = 0;		// First digit of hours
-	static uint8_t hours_2 = 0;		// Second digit of hours
-	char lcd_string[8] = " ";      // String for converting numbers by itoa()
+	dht12_stats_t dht12;
 	
-	// ADC variables
-	uint16_t air_val = 920;	// Needs to be calibrated with each device
-	uint16_t water_val = 760;	// Needs to be calibrated with each device
-	uint16_t day_val = 100;	// Needs to be calibrated with each device
+	// ADC variables, calibration values are in settings
 	static uint16_t raw_value = 0;
-	char temp_str[3] = "";
+	char temp_str[FMT_U16_LEN];
 	
 	/**********************************************************************
 	 * Switch statement
 	 * Purpose: Functions as a state machine. FSM has 8 states in total. 
 	 * STATE_IDLE: Add counter 
-	 * STATE_GET_TEMP: Measures temperature and updates LCD display.
-	 * STATE_STATE_GET_MOIST: Measures soil humidity and updates LCD display.
-	 * STATE_STATE_GET_TIME: Takes time from clock and displays it on LCD.
-	 * STATE_GET_LIGHT: Measures luminance and updates it on LCD display.
+	 * STATE_GET_TEMP: Starts background scan of all DHT12 sensors.
+	 * STATE_STATE_GET_MOIST: Measures soil humidity.
+	 * STATE_STATE_GET_TIME: Takes time from clock.
+	 * STATE_GET_LIGHT: Measures luminance.
 	 * STATE_TOGGLE_BULB: Turns on lights when it's too dark.
 	 * STATE_TOGGLE_SPRNKL: Turns on watering when the soil moisture is too low.
-	 * STATE_TOGGLE_VENT: Turn on ventilator when temperature is too high.
+	 * STATE_TOGGLE_VENT: Updates average temperature, sends min/avg/max
+	 *                    via UART and turns on ventilator when
+	 *                    temperature is too high.
+	 * The LCD shows the variables bound to its pages, see lcd_pages.
 	 **********************************************************************/
+	twi_tick();		// Abort TWI transaction stuck since the previous tick
+	
 	switch(state) {
 	
 	case STATE_IDLE:
 		if (counter >= 455) { // 33ms x 455 = 15s (approx.)
 			counter = 0;
+			twi_rescan();		// Probe one absent device, it is used again when it responds
 			state = STATE_GET_TEMP;
 		}
 		else if (counter % 6 == 0) { // 33ms x 6 = 200ms (approx.)
@@ -229,61 +674,42 @@ ISR(TIMER1_OVF_vect)
 		break;
 		
 	case STATE_GET_TEMP:
-		err = twi_start((0x5c<<1) + TWI_WRITE);	// Send address byte to slave device
-		if (err == 0) {
-			twi_write(0x2); // Sending the data
+		// Scan all DHT12 sensors, results are processed in STATE_TOGGLE_VENT
+		dht12_scan();
+		
+		state = STATE_GET_MOIST;
+		break;
+		
+	case STATE_TOGGLE_VENT:
+		if (dht12_busy()) {
+			// Scan not finished yet, keep the previous values
 		}
-		else {
-			// Debug check
-			uart_puts("Device not found.\r\n"); 
-		}
-				
-		err = twi_start((0x5c<<1) + TWI_READ); // Send address byte to master
-		if (err == 0) {
-			// Create a temperature string
-			// Get first part of the temperature information (integer part)
-			temperature = twi_read_ack();	   // 
-			itoa(temperature, temperature1, 10);		// Convert integer temperature to decimal values
+		else if (dht12_stats(&dht12) != 0) {
+			temperature = dht12.temp_avg;
+			regmap.temp = dht12.temp_avg;
+			regmap.humid = dht12.humid_avg;
+			climate = dht12;
 			
-			// Get second part of the temperature information (fractional part)
-			temperature = twi_read_nack();
-			itoa(temperature, temperature2, 10);		// Convert fractional temperature to decimal values
-			
-			// Display temperature via UART
-			// uart_puts("Temperature: ");
-			// uart_puts(temperature1);
-			// uart_puts(".");
-			// uart_puts(temperature2);
-			// uart_puts("\r\n");
-			
-			// Update LCD display ("xx,xC")
-			lcd_gotoxy(11, 0);
-			lcd_puts(temperature1);
-			lcd_puts(".");
-			lcd_puts(temperature2);
-			lcd_gotoxy(15, 0);
-			lcd_putc(0xdf);
-			lcd_putc('C');
-			
-			// Get integer from a string
-			temperature = atoi(temperature1);
+			// Display values via UART
+			if (telemetry_mode() == TELEMETRY_TEXT) {
+				uart_puts_min_avg_max("Temperature", dht12.temp_min, dht12.temp_avg, dht12.temp_max);
+				uart_puts_min_avg_max("Humidity", dht12.humid_min, dht12.humid_avg, dht12.humid_max);
+			}
 		}
 		else {
 			// Debug check
-			// uart_puts("Temperature unavailable.\r\n");
+			log_puts("Device not found.\r\n");
 		}
 		
-		state = STATE_GET_MOIST;
-		break;
-		
-	case STATE_TOGGLE_VENT:
-		if (temperature > 28) {					// After 28C turn on the ventilator
+		if (temperature > settings.temp_on) {	// Too warm, turn on the ventilator
 			GPIO_write_high(&PORTD, VENT_PIN);	// Ventilator ON
+			regmap.relays |= REGMAP_VENT;
 			// Debug check
-			uart_puts("Ventilation ON\r\n");	
+			log_puts("Ventilation ON\r\n");	
 		}
 		else {
 			GPIO_write_low(&PORTD, VENT_PIN);	// Ventilator OFF
+			regmap.relays &= ~REGMAP_VENT;
 		}
 		
 		state = STATE_TOGGLE_SPRNKL;			
@@ -291,99 +717,90 @@ ISR(TIMER1_OVF_vect)
 		
 	case STATE_GET_MOIST:
 		raw_value = readADC0();
+		telemetry.adc_moist = raw_value;
 
 		// Get moisture value in %
-		if (raw_value > air_val) {
-			raw_value = air_val;		// 960 is the lowest moisture value from the device
+		if (raw_value > settings.air_val) {
+			raw_value = settings.air_val;		// Lowest moisture value from the device
 		}
-		else if (raw_value < water_val) {
-			raw_value = water_val;		// 720 is the highest moisture value from the device
+		else if (raw_value < settings.water_val) {
+			raw_value = settings.water_val;		// Highest moisture value from the device
 		}
 		
-		raw_value = round(100 * (1 - (float)(raw_value-water_val)/(float)(air_val-water_val))); // Getting moisture percentage value
-		itoa(raw_value, temp_str, 10);
+		raw_value = round(100 * (1 - (float)(raw_value-settings.water_val)/(float)(settings.air_val-settings.water_val))); // Getting moisture percentage value
+		fmt_u8(temp_str, sizeof(temp_str), raw_value, 0);
 		adc_moist = raw_value;
+		regmap.moist = raw_value;
+		lcd_graph_push(&moist_hist, raw_value);
 		
 		// Debug check
-		uart_puts("Moisture value: ");
-		uart_puts(temp_str);
-		uart_puts("\r\n");
-		
-		// Update the moisture value on LCD
-		lcd_gotoxy(1, 1);
-		lcd_puts("   ");
-		lcd_gotoxy(1, 1);
-		lcd_puts(temp_str);
-		lcd_gotoxy(4, 1);
-		lcd_puts("%");
+		log_puts("Moisture value: ");
+		log_puts(temp_str);
+		log_puts("\r\n");
 		
 		state = STATE_GET_TIME;
 		break;
 		
 	case STATE_TOGGLE_SPRNKL:
-		if (adc_moist < 80) {			// Start watering when soil moisture is below 80 %
+		if (adc_moist < settings.moist_on) {	// Start watering when soil is too dry
 			GPIO_write_high(&PORTD, SPRNKL_PIN);	// Watering ON
+			regmap.relays |= REGMAP_SPRNKL;
 			// Debug check
-			uart_puts("Water ON\r\n");
+			log_puts("Water ON\r\n");
 		}
 		else {
 			GPIO_write_low(&PORTD, SPRNKL_PIN);		// Watering OFF
+			regmap.relays &= ~REGMAP_SPRNKL;
+		}
+		if (telemetry_mode() == TELEMETRY_TEXT) {
+			uart_puts_twi_devices(0);
+		}
+		
+		// Store and send record of the whole scan cycle, the log keeps its sequence number
+		telemetry_stamp(&telemetry);
+		telemetry.hours = regmap.hours;
+		telemetry.minutes = regmap.minutes;
+		telemetry.seconds = regmap.seconds;
+		telemetry.temp = temperature;
+		telemetry.relays = regmap.relays;
+		log_recs[log_next] = telemetry;
+		log_next = (log_next + 1) % LOG_LEN;
+		if (log_count < LOG_LEN) {
+			log_count++;
+		}
+		if (telemetry_mode() == TELEMETRY_BINARY) {
+			telemetry_send(&telemetry);
 		}
 		state = STATE_IDLE;
 		break;
 	
 	case STATE_GET_TIME:
-		err = twi_start((0x68<<1) + TWI_WRITE);		// Starting communication with slave
-		if (err == 0){								// Device is accessible
-			twi_write(0x00);						// Sending message to slave
+		// Absent RTC is skipped until twi_rescan() finds it again
+		if (!twi_dev_present(RTC_ADDRESS)) {
+			// Nothing to display
 		}
-	
-		err = twi_start((0x68<<1) + TWI_READ);		// Starting communication with master
-		if (err == 0){
-			lcd_gotoxy(0, 0);
-			lcd_puts("00:00:00");
-		
-			seconds = twi_read_ack();
-			seconds_1 = (seconds & 0b00001111);				// Getting first digit of seconds
-			seconds_2 = ((seconds >> 4) & 0b00000111);		// Getting second digit of seconds
-			itoa(seconds_1, lcd_string, 10);				// Converting to decimal values
-			
-			// Update seconds on LCD
-			lcd_gotoxy(7, 0);
-			lcd_puts(lcd_string);
-			itoa(seconds_2, lcd_string, 10);
-			lcd_gotoxy(6, 0);
-			lcd_puts(lcd_string);
-		
-			minutes = twi_read_ack();
-			minutes_1 = minutes & 0b00001111;				// Getting first digit of minutes
-			minutes_2 = minutes >> 4 & 0b00000111;			// Getting second digit of minutes
-			itoa(minutes_1, lcd_string, 10);				// Converting to decimal values
-			
-			// Update minutes on LCD
-			lcd_gotoxy(4, 0);
-			lcd_puts(lcd_string);
-			itoa(minutes_2, lcd_string, 10);
-			lcd_gotoxy(3, 0);
-			lcd_puts(lcd_string);
-		
-			hours = twi_read_ack();
-			hours_1 = hours & 0b00001111;					// Getting first digit of hours
-			hours_2 = hours >> 4 & 0b00000011;				// Getting second digit of hours
-			itoa(hours_1, lcd_string, 10);					// Converting to decimal values
-			
-			// Update hours on LCD
-			lcd_gotoxy(1, 0);
-			lcd_puts(lcd_string);
-			itoa(hours_2, lcd_string, 10);
-			lcd_gotoxy(0, 0);
-			lcd_puts(lcd_string);
+		// Display the time read during the previous pass (200 ms ago)
+		else if (rtc_trans.status == TWI_OK){
+			regmap.hours = rtc_data[2];
+			regmap.minutes = rtc_data[1];
+			regmap.seconds = rtc_data[0];
 		}
-		else {
+		else if (rtc_trans.status != TWI_PENDING) {
 			// Debug check
-			uart_puts("Device not found.\r\n");
+			log_puts("Device not found.\r\n");
 		}
 		
+		// Queue next reading of RTC
+		if (rtc_trans.status != TWI_PENDING && twi_dev_present(RTC_ADDRESS)) {
+			twi_submit(&rtc_trans);
+		}
+		
+		// Publish all registers to TWI master, retried next time when it is reading
+		regmap.temp_on = settings.temp_on;
+		regmap.moist_on = settings.moist_on;
+		regmap.light_on = settings.light_on;
+		regmap_publish();
+		
 		if (counter == 0) {
 			state = STATE_GET_LIGHT;
 		}
@@ -394,36 +811,35 @@ ISR(TIMER1_OVF_vect)
 		
 	case STATE_GET_LIGHT:
 		raw_value = readADC1();
+		telemetry.adc_light = raw_value;
 		
-		if (raw_value > day_val) {
-			raw_value = day_val;
+		if (raw_value > settings.day_val) {
+			raw_value = settings.day_val;
 		}
 		
-		itoa(raw_value, temp_str, 10);
+		fmt_u16(temp_str, sizeof(temp_str), raw_value, 0);
 		adc_light = raw_value;
+		light_level = (uint32_t)raw_value * 100 / settings.day_val;	// day_val is 1 to 1023
+		regmap.light = light_level;
+		lcd_graph_push(&light_hist, light_level);
 		// Debug check
-		uart_puts("Light value: ");
-		uart_puts(temp_str);
-		uart_puts("\r\n");
+		log_puts("Light value: ");
+		log_puts(temp_str);
+		log_puts("\r\n");
 		
-		// Update the LCD
-		lcd_gotoxy(11, 1);
-		lcd_puts("   ");
-		lcd_gotoxy(11, 1);
-		lcd_puts(temp_str);
-		lcd_gotoxy(14, 1);
-		lcd_puts("%");
 		state = STATE_TOGGLE_BULB;
 		break;
 		
 	case STATE_TOGGLE_BULB:
-		if (adc_light < 60) {			
+		if (light_level < settings.light_on) {	// Too dark, turn on the lights
 			GPIO_write_high(&PORTB, BULB_PIN); // Turn lights ON
+			regmap.relays |= REGMAP_BULB;
 			// Debug check
-			uart_puts("Light ON\r\n");
+			log_puts("Light ON\r\n");
 		}
 		else {
 			GPIO_write_low(&PORTB, BULB_PIN); // Turn lights OFF
+			regmap.relays &= ~REGMAP_BULB;
 		}
 		state = STATE_TOGGLE_VENT;
 		break;
@@ -432,5 +848,8 @@ ISR(TIMER1_OVF_vect)
 		state = STATE_IDLE;
 		break;
 	}
-	// Else do nothing and exit the ISR
+	
+	// Draw fields changed by this state and send the LCD cells that differ
+	lcd_ui_update();
+	lcd_fb_flush();
 }
\ No newline at end of file
@@ -0,0 +1,50 @@
+/***********************************************************************
+ *
+ * Register map of greenhouse controller for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/* Includes ----------------------------------------------------------*/
+#include <stddef.h>
+#include <string.h>
+#include "twi.h"
+#include "regmap.h"
+
+/* Variables ---------------------------------------------------------*/
+regmap_t regmap = {.version = REGMAP_VERSION};  // Working copy of registers
+static regmap_t regmap_buf[2];                  // Buffers served to masters
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: regmap_init()
+ * Purpose:  Start serving the register map as TWI slave.
+ * Returns:  none
+ **********************************************************************/
+void regmap_init(void)
+{
+    regmap_buf[0] = regmap;
+    twi_slave_init(REGMAP_ADDRESS, (uint8_t *)&regmap_buf[0],
+                   (uint8_t *)&regmap_buf[1], sizeof(regmap_t));
+}
+
+/**********************************************************************
+ * Function: regmap_publish()
+ * Purpose:  Publish working copy of registers to masters.
+ * Returns:  0 - Published, 1 - Master is reading, try again later
+ **********************************************************************/
+uint8_t regmap_publish(void)
+{
+    uint8_t *back = twi_slave_back();
+
+    if (back == NULL)
+    {
+        return 1;
+    }
+    regmap.seq++;
+    memcpy(back, &regmap, sizeof(regmap_t));
+    twi_slave_publish();
+    return 0;
+}
@@ -0,0 +1,102 @@
+#ifndef REGMAP_H
+# define REGMAP_H
+
+/***********************************************************************
+ * 
+ * Register map of greenhouse controller for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/**
+ * @file 
+ * @defgroup regmap Register Map <regmap.h>
+ * @code #include "regmap.h" @endcode
+ *
+ * @brief Register map of greenhouse controller served as TWI slave.
+ *
+ * A supervisory master reads the map at address REGMAP_ADDRESS: it
+ * writes the register address and reads the registers after repeated
+ * START. The application updates the values in variable regmap and
+ * publishes them by regmap_publish(). 16-bit registers are sent LSB
+ * first.
+ *
+ * | Reg  | Name        | Description                              |
+ * |------|-------------|------------------------------------------|
+ * | 0x00 | version     | REGMAP_VERSION                           |
+ * | 0x01 | seq         | Incremented by every publish             |
+ * | 0x02 | temp        | Average air temperature in 0.1 degC      |
+ * | 0x04 | humid       | Average air humidity in 0.1 %            |
+ * | 0x06 | moist       | Soil moisture in %                       |
+ * | 0x07 | light       | Light level in %                         |
+ * | 0x08 | relays      | REGMAP_VENT, REGMAP_SPRNKL, REGMAP_BULB   |
+ * | 0x09 | hours       | Time of RTC, BCD                         |
+ * | 0x0a | minutes     | Time of RTC, BCD                         |
+ * | 0x0b | seconds     | Time of RTC, BCD                         |
+ * | 0x0c | temp_on     | Ventilation threshold in 0.1 degC        |
+ * | 0x0e | moist_on    | Watering threshold in %                  |
+ * | 0x0f | light_on    | Lighting threshold in %                  |
+ * @{
+ */
+
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+
+
+/* Defines -----------------------------------------------------------*/
+#ifndef REGMAP_ADDRESS
+# define REGMAP_ADDRESS 0x30 /**< @brief Own TWI slave address */
+#endif
+#define REGMAP_VERSION 1 /**< @brief Layout version of register map */
+
+#define REGMAP_VENT 0x01 /**< @brief Relay bit: Ventilation */
+#define REGMAP_SPRNKL 0x02 /**< @brief Relay bit: Watering */
+#define REGMAP_BULB 0x04 /**< @brief Relay bit: Lighting */
+
+/** @brief Registers of greenhouse controller */
+typedef struct {
+    uint8_t version;        /**< @brief Layout version */
+    uint8_t seq;            /**< @brief Publish counter */
+    int16_t temp;           /**< @brief Temperature in 0.1 degC */
+    uint16_t humid;         /**< @brief Humidity in 0.1 % */
+    uint8_t moist;          /**< @brief Soil moisture in % */
+    uint8_t light;          /**< @brief Light level in % */
+    uint8_t relays;         /**< @brief States of relays */
+    uint8_t hours;          /**< @brief Hours, BCD */
+    uint8_t minutes;        /**< @brief Minutes, BCD */
+    uint8_t seconds;        /**< @brief Seconds, BCD */
+    int16_t temp_on;        /**< @brief Ventilation threshold in 0.1 degC */
+    uint8_t moist_on;       /**< @brief Watering threshold in % */
+    uint8_t light_on;       /**< @brief Lighting threshold in % */
+} regmap_t;
+
+/** @brief Working copy of registers, updated by the application */
+extern regmap_t regmap;
+
+
+/* Function prototypes -----------------------------------------------*/
+/**
+ * @name Functions
+ */
+
+/**
+ * @brief  Start serving the register map as TWI slave.
+ * @return none
+ * @note   Call after twi_init().
+ */
+void regmap_init(void);
+
+
+/**
+ * @brief  Publish working copy of registers to masters.
+ * @retval 0 - Registers published
+ * @retval 1 - A master is reading the previous values, try again later
+ */
+uint8_t regmap_publish(void);
+
+/** @} */
+
+#endif
@@ -0,0 +1,149 @@
+/***********************************************************************
+ *
+ * Run-time settings of greenhouse controller for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/* Includes ----------------------------------------------------------*/
+#include <stddef.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include "settings.h"
+
+/* Defines -----------------------------------------------------------*/
+#define SETTINGS_WORD 2         // Setting stored in 16 bits
+#define SETTINGS_BYTE 1         // Setting stored in 8 bits
+
+/* Variables ---------------------------------------------------------*/
+settings_t settings = {
+    .temp_on = SETTINGS_TEMP_ON,
+    .moist_on = SETTINGS_MOIST_ON,
+    .light_on = SETTINGS_LIGHT_ON,
+    .air_val = SETTINGS_AIR_VAL,
+    .water_val = SETTINGS_WATER_VAL,
+    .day_val = SETTINGS_DAY_VAL
+};
+
+/* Description of one setting, stored in flash */
+typedef struct {
+    const char *name;           // Name used by console, in flash
+    void *value;                // Member of settings
+    uint8_t size;               // SETTINGS_WORD or SETTINGS_BYTE
+    int16_t min;                // Lowest accepted value
+    int16_t max;                // Highest accepted value
+} settings_item_t;
+
+static const char settings_temp_on[] PROGMEM = "temp_on";
+static const char settings_moist_on[] PROGMEM = "moist_on";
+static const char settings_light_on[] PROGMEM = "light_on";
+static const char settings_air_val[] PROGMEM = "air_val";
+static const char settings_water_val[] PROGMEM = "water_val";
+static const char settings_day_val[] PROGMEM = "day_val";
+
+static const settings_item_t settings_items[] PROGMEM = {
+    {settings_temp_on, &settings.temp_on, SETTINGS_WORD, -400, 800},
+    {settings_moist_on, &settings.moist_on, SETTINGS_BYTE, 0, 100},
+    {settings_light_on, &settings.light_on, SETTINGS_BYTE, 0, 100},
+    {settings_air_val, &settings.air_val, SETTINGS_WORD, 1, 1023},
+    {settings_water_val, &settings.water_val, SETTINGS_WORD, 0, 1022},
+    {settings_day_val, &settings.day_val, SETTINGS_WORD, 1, 1023}
+};
+
+#define SETTINGS_COUNT (sizeof(settings_items) / sizeof(settings_items[0]))
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: settings_name()
+ * Purpose:  Get name of a setting.
+ * Input:    index Index of setting
+ * Returns:  Name in flash, NULL past the last setting
+ **********************************************************************/
+const char *settings_name(uint8_t index)
+{
+    if (index >= SETTINGS_COUNT)
+    {
+        return NULL;
+    }
+    return pgm_read_ptr(&settings_items[index].name);
+}
+
+/**********************************************************************
+ * Function: settings_find()
+ * Purpose:  Find setting by name.
+ * Input:    name Name of setting
+ * Returns:  Index of setting, -1 if not found
+ **********************************************************************/
+int8_t settings_find(const char *name)
+{
+    uint8_t i;
+
+    for (i = 0; i < SETTINGS_COUNT; i++)
+    {
+        if (strcmp_P(name, settings_name(i)) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**********************************************************************
+ * Function: settings_get()
+ * Purpose:  Get value of a setting.
+ * Input:    index Index of setting
+ * Returns:  Value
+ **********************************************************************/
+int16_t settings_get(uint8_t index)
+{
+    settings_item_t item;
+
+    memcpy_P(&item, &settings_items[index], sizeof(item));
+    if (item.size == SETTINGS_BYTE)
+    {
+        return *(uint8_t *)item.value;
+    }
+    return *(int16_t *)item.value;
+}
+
+/**********************************************************************
+ * Function: settings_set()
+ * Purpose:  Check range and change value of a setting. The moisture
+ *           sensor reads less in water than in air, so water_val must
+ *           stay below air_val.
+ * Input:    index Index of setting
+ *           value New value
+ * Returns:  0 - Changed, 1 - Value rejected
+ **********************************************************************/
+uint8_t settings_set(uint8_t index, int16_t value)
+{
+    settings_item_t item;
+
+    memcpy_P(&item, &settings_items[index], sizeof(item));
+    if (value < item.min || value > item.max)
+    {
+        return 1;
+    }
+    if ((item.value == &settings.air_val && value <= (int16_t)settings.water_val) ||
+        (item.value == &settings.water_val && value >= (int16_t)settings.air_val))
+    {
+        return 1;
+    }
+
+    if (item.size == SETTINGS_BYTE)
+    {
+        *(uint8_t *)item.value = value;
+    }
+    else
+    {
+        // Control loop in timer interrupt must not see half of the value
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            *(int16_t *)item.value = value;
+        }
+    }
+    return 0;
+}
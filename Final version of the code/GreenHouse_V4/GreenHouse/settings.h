@@ -0,0 +1,115 @@
+#ifndef SETTINGS_H
+# define SETTINGS_H
+
+/***********************************************************************
+ *
+ * Run-time settings of greenhouse controller for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/**
+ * @file
+ * @defgroup settings Settings <settings.h>
+ * @code #include "settings.h" @endcode
+ *
+ * @brief Thresholds and sensor calibration changeable at run time.
+ *
+ * The control loop reads the values from variable settings. Other code
+ * changes them only by settings_set(), which checks the range and
+ * updates 16-bit values with interrupts disabled. Each setting has a
+ * name, so a console can list and change them.
+ *
+ * | Name      | Default | Description                              |
+ * |-----------|---------|------------------------------------------|
+ * | temp_on   | 280     | Ventilation above temperature in 0.1 degC |
+ * | moist_on  | 80      | Watering below soil moisture in %        |
+ * | light_on  | 60      | Lighting below light level in %          |
+ * | air_val   | 920     | ADC value of moisture sensor in air      |
+ * | water_val | 760     | ADC value of moisture sensor in water    |
+ * | day_val   | 100     | ADC value of light sensor at full light  |
+ * @{
+ */
+
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+
+
+/* Defines -----------------------------------------------------------*/
+#ifndef SETTINGS_TEMP_ON
+# define SETTINGS_TEMP_ON 280 /**< @brief Default ventilation threshold in 0.1 degC */
+#endif
+#ifndef SETTINGS_MOIST_ON
+# define SETTINGS_MOIST_ON 80 /**< @brief Default watering threshold in % */
+#endif
+#ifndef SETTINGS_LIGHT_ON
+# define SETTINGS_LIGHT_ON 60 /**< @brief Default lighting threshold in % */
+#endif
+#ifndef SETTINGS_AIR_VAL
+# define SETTINGS_AIR_VAL 920 /**< @brief Default ADC value of dry moisture sensor */
+#endif
+#ifndef SETTINGS_WATER_VAL
+# define SETTINGS_WATER_VAL 760 /**< @brief Default ADC value of wet moisture sensor */
+#endif
+#ifndef SETTINGS_DAY_VAL
+# define SETTINGS_DAY_VAL 100 /**< @brief Default ADC value of light sensor */
+#endif
+
+/** @brief Thresholds and calibration */
+typedef struct {
+    int16_t temp_on;        /**< @brief Ventilation threshold in 0.1 degC */
+    uint8_t moist_on;       /**< @brief Watering threshold in % */
+    uint8_t light_on;       /**< @brief Lighting threshold in % */
+    uint16_t air_val;       /**< @brief ADC value of moisture sensor in air */
+    uint16_t water_val;     /**< @brief ADC value of moisture sensor in water */
+    uint16_t day_val;       /**< @brief ADC value of light sensor at full light */
+} settings_t;
+
+/** @brief Current settings, read-only outside this module */
+extern settings_t settings;
+
+
+/* Function prototypes -----------------------------------------------*/
+/**
+ * @name Functions
+ */
+
+/**
+ * @brief  Get name of a setting.
+ * @param  index Index of setting, starting at 0
+ * @return Name in flash, NULL if index is past the last setting
+ */
+const char *settings_name(uint8_t index);
+
+
+/**
+ * @brief  Find setting by name.
+ * @param  name Name of setting
+ * @return Index of setting, -1 if there is no such setting
+ */
+int8_t settings_find(const char *name);
+
+
+/**
+ * @brief  Get value of a setting.
+ * @param  index Index of setting
+ * @return Value
+ */
+int16_t settings_get(uint8_t index);
+
+
+/**
+ * @brief  Change value of a setting.
+ * @param  index Index of setting
+ * @param  value New value
+ * @retval 0 - Value changed
+ * @retval 1 - Value out of range, or water_val not below air_val
+ */
+uint8_t settings_set(uint8_t index, int16_t value);
+
+/** @} */
+
+#endif
@@ -0,0 +1,732 @@
+/***********************************************************************
+ *
+ * SSD1306 OLED backend of the HD44780 LCD library for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * Implements the functions of lcd.h for a 128x64 OLED with SSD1306
+ * controller on I2C, selected by LCD_IO_MODE == LCD_IO_SSD1306. The
+ * panel is a grid of 8x8 pixel tiles, one character each, drawn from
+ * a 5x7 font in flash. Only the characters of the tiles are kept in
+ * RAM, with one dirty bit per tile, instead of a 1 KB framebuffer.
+ * lcd_tick() sends dirty tiles of a line as one I2C write. Custom
+ * characters 0 to 7 are written to an emulated CGRAM as on HD44780.
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/* Includes ----------------------------------------------------------*/
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "lcd.h"
+
+#if LCD_IO_MODE == LCD_IO_SSD1306
+#include "twi.h"
+
+/* Defines -----------------------------------------------------------*/
+#if !LCD_ASYNC
+# error LCD_IO_SSD1306 requires LCD_ASYNC, tiles are sent by lcd_tick()
+#endif
+#if LCD_USE_RW
+# error LCD_USE_RW is not supported by LCD_IO_SSD1306
+#endif
+#if LCD_LINES > 8 || LCD_DISP_LENGTH > 16
+# error LCD_IO_SSD1306 shows at most 8 lines of 16 characters
+#endif
+#if LCD_SSD1306_BATCH < 1 || LCD_SSD1306_BATCH > 31
+# error LCD_SSD1306_BATCH must be 1 to 31
+#endif
+
+#define SSD1306_PAGES 8         // Pages of 8 pixel rows, 64 rows
+#define SSD1306_WIDTH 128       // Columns of pixels
+#define SSD1306_TILE 8          // Columns of pixels of one tile
+#define SSD1306_FONT_FIRST 0x20 // First character of font
+#define SSD1306_FONT_COLUMNS 5  // Columns of 5x7 font and custom characters
+#define SSD1306_CG_CHARS 8      // Custom characters
+#define SSD1306_CG_ROWS 8       // Rows of custom character
+#define SSD1306_DDRAM 0xff      // Data bytes are characters, not CGRAM rows
+#define SSD1306_CLEAR_CHUNK 16  // Zero bytes of one write when clearing
+
+#define SSD1306_CMD 0x00        // Control byte, commands follow
+#define SSD1306_CMD_ONE 0x80    // Control byte, one command follows
+#define SSD1306_DATA 0x40       // Control byte, display data follow
+#define SSD1306_DISPLAY_OFF 0xae
+#define SSD1306_DISPLAY_ON 0xaf
+#define SSD1306_PAGE 0xb0       // Page address 0 to 7, page addressing mode
+#define SSD1306_COLUMN_LOW 0x00 // Lower nibble of column address
+#define SSD1306_COLUMN_HIGH 0x10    // Upper nibble of column address
+#define SSD1306_HEADER 7        // Bytes addressing a run of tiles
+
+/* Variables ---------------------------------------------------------*/
+// Set-up of 128x64 panel with internal charge pump, display stays off
+static const uint8_t ssd1306_setup[] PROGMEM = {
+    SSD1306_DISPLAY_OFF,
+    0xd5, 0x80,             // Clock divide ratio and oscillator frequency
+    0xa8, 0x3f,             // Multiplex ratio, 64 rows
+    0xd3, 0x00,             // No display offset
+    0x40,                   // Start line 0
+    0x8d, 0x14,             // Charge pump on
+    0x20, 0x02,             // Page addressing mode
+    0xa1,                   // Column 127 is SEG0, column 0 on the left
+    0xc8,                   // COM scan from COM63, page 0 on the top
+    0xda, 0x12,             // Alternative COM pins
+    0x81, 0xcf,             // Contrast
+    0xd9, 0xf1,             // Pre-charge period
+    0xdb, 0x40,             // VCOMH deselect level
+    0xa4,                   // Output follows RAM
+    0xa6                    // Not inverted
+};
+
+// Columns of characters 0x20 to 0x7f, bit 0 is the top row. 0x7e and
+// 0x7f are arrows as in the HD44780 character ROM.
+static const uint8_t ssd1306_font[][SSD1306_FONT_COLUMNS] PROGMEM = {
+    {0x00, 0x00, 0x00, 0x00, 0x00},     // ' '
+    {0x00, 0x00, 0x5f, 0x00, 0x00},     // '!'
+    {0x00, 0x07, 0x00, 0x07, 0x00},     // '"'
+    {0x14, 0x7f, 0x14, 0x7f, 0x14},     // '#'
+    {0x24, 0x2a, 0x7f, 0x2a, 0x12},     // '$'
+    {0x23, 0x13, 0x08, 0x64, 0x62},     // '%'
+    {0x36, 0x49, 0x55, 0x22, 0x50},     // '&'
+    {0x00, 0x05, 0x03, 0x00, 0x00},     // '''
+    {0x00, 0x1c, 0x22, 0x41, 0x00},     // '('
+    {0x00, 0x41, 0x22, 0x1c, 0x00},     // ')'
+    {0x14, 0x08, 0x3e, 0x08, 0x14},     // '*'
+    {0x08, 0x08, 0x3e, 0x08, 0x08},     // '+'
+    {0x00, 0x50, 0x30, 0x00, 0x00},     // ','
+    {0x08, 0x08, 0x08, 0x08, 0x08},     // '-'
+    {0x00, 0x60, 0x60, 0x00, 0x00},     // '.'
+    {0x20, 0x10, 0x08, 0x04, 0x02},     // '/'
+    {0x3e, 0x51, 0x49, 0x45, 0x3e},     // '0'
+    {0x00, 0x42, 0x7f, 0x40, 0x00},     // '1'
+    {0x42, 0x61, 0x51, 0x49, 0x46},     // '2'
+    {0x21, 0x41, 0x45, 0x4b, 0x31},     // '3'
+    {0x18, 0x14, 0x12, 0x7f, 0x10},     // '4'
+    {0x27, 0x45, 0x45, 0x45, 0x39},     // '5'
+    {0x3c, 0x4a, 0x49, 0x49, 0x30},     // '6'
+    {0x01, 0x71, 0x09, 0x05, 0x03},     // '7'
+    {0x36, 0x49, 0x49, 0x49, 0x36},     // '8'
+    {0x06, 0x49, 0x49, 0x29, 0x1e},     // '9'
+    {0x00, 0x36, 0x36, 0x00, 0x00},     // ':'
+    {0x00, 0x56, 0x36, 0x00, 0x00},     // ';'
+    {0x08, 0x14, 0x22, 0x41, 0x00},     // '<'
+    {0x14, 0x14, 0x14, 0x14, 0x14},     // '='
+    {0x00, 0x41, 0x22, 0x14, 0x08},     // '>'
+    {0x02, 0x01, 0x51, 0x09, 0x06},     // '?'
+    {0x32, 0x49, 0x79, 0x41, 0x3e},     // '@'
+    {0x7e, 0x11, 0x11, 0x11, 0x7e},     // 'A'
+    {0x7f, 0x49, 0x49, 0x49, 0x36},     // 'B'
+    {0x3e, 0x41, 0x41, 0x41, 0x22},     // 'C'
+    {0x7f, 0x41, 0x41, 0x22, 0x1c},     // 'D'
+    {0x7f, 0x49, 0x49, 0x49, 0x41},     // 'E'
+    {0x7f, 0x09, 0x09, 0x09, 0x01},     // 'F'
+    {0x3e, 0x41, 0x49, 0x49, 0x7a},     // 'G'
+    {0x7f, 0x08, 0x08, 0x08, 0x7f},     // 'H'
+    {0x00, 0x41, 0x7f, 0x41, 0x00},     // 'I'
+    {0x20, 0x40, 0x41, 0x3f, 0x01},     // 'J'
+    {0x7f, 0x08, 0x14, 0x22, 0x41},     // 'K'
+    {0x7f, 0x40, 0x40, 0x40, 0x40},     // 'L'
+    {0x7f, 0x02, 0x0c, 0x02, 0x7f},     // 'M'
+    {0x7f, 0x04, 0x08, 0x10, 0x7f},     // 'N'
+    {0x3e, 0x41, 0x41, 0x41, 0x3e},     // 'O'
+    {0x7f, 0x09, 0x09, 0x09, 0x06},     // 'P'
+    {0x3e, 0x41, 0x51, 0x21, 0x5e},     // 'Q'
+    {0x7f, 0x09, 0x19, 0x29, 0x46},     // 'R'
+    {0x46, 0x49, 0x49, 0x49, 0x31},     // 'S'
+    {0x01, 0x01, 0x7f, 0x01, 0x01},     // 'T'
+    {0x3f, 0x40, 0x40, 0x40, 0x3f},     // 'U'
+    {0x1f, 0x20, 0x40, 0x20, 0x1f},     // 'V'
+    {0x3f, 0x40, 0x38, 0x40, 0x3f},     // 'W'
+    {0x63, 0x14, 0x08, 0x14, 0x63},     // 'X'
+    {0x07, 0x08, 0x70, 0x08, 0x07},     // 'Y'
+    {0x61, 0x51, 0x49, 0x45, 0x43},     // 'Z'
+    {0x00, 0x7f, 0x41, 0x41, 0x00},     // '['
+    {0x02, 0x04, 0x08, 0x10, 0x20},     // '\'
+    {0x00, 0x41, 0x41, 0x7f, 0x00},     // ']'
+    {0x04, 0x02, 0x01, 0x02, 0x04},     // '^'
+    {0x40, 0x40, 0x40, 0x40, 0x40},     // '_'
+    {0x00, 0x01, 0x02, 0x04, 0x00},     // '`'
+    {0x20, 0x54, 0x54, 0x54, 0x78},     // 'a'
+    {0x7f, 0x48, 0x44, 0x44, 0x38},     // 'b'
+    {0x38, 0x44, 0x44, 0x44, 0x20},     // 'c'
+    {0x38, 0x44, 0x44, 0x48, 0x7f},     // 'd'
+    {0x38, 0x54, 0x54, 0x54, 0x18},     // 'e'
+    {0x08, 0x7e, 0x09, 0x01, 0x02},     // 'f'
+    {0x0c, 0x52, 0x52, 0x52, 0x3e},     // 'g'
+    {0x7f, 0x08, 0x04, 0x04, 0x78},     // 'h'
+    {0x00, 0x44, 0x7d, 0x40, 0x00},     // 'i'
+    {0x20, 0x40, 0x44, 0x3d, 0x00},     // 'j'
+    {0x7f, 0x10, 0x28, 0x44, 0x00},     // 'k'
+    {0x00, 0x41, 0x7f, 0x40, 0x00},     // 'l'
+    {0x7c, 0x04, 0x18, 0x04, 0x78},     // 'm'
+    {0x7c, 0x08, 0x04, 0x04, 0x78},     // 'n'
+    {0x38, 0x44, 0x44, 0x44, 0x38},     // 'o'
+    {0x7c, 0x14, 0x14, 0x14, 0x08},     // 'p'
+    {0x08, 0x14, 0x14, 0x18, 0x7c},     // 'q'
+    {0x7c, 0x08, 0x04, 0x04, 0x08},     // 'r'
+    {0x48, 0x54, 0x54, 0x54, 0x20},     // 's'
+    {0x04, 0x3f, 0x44, 0x40, 0x20},     // 't'
+    {0x3c, 0x40, 0x40, 0x20, 0x7c},     // 'u'
+    {0x1c, 0x20, 0x40, 0x20, 0x1c},     // 'v'
+    {0x3c, 0x40, 0x30, 0x40, 0x3c},     // 'w'
+    {0x44, 0x28, 0x10, 0x28, 0x44},     // 'x'
+    {0x0c, 0x50, 0x50, 0x50, 0x3c},     // 'y'
+    {0x44, 0x64, 0x54, 0x4c, 0x44},     // 'z'
+    {0x00, 0x08, 0x36, 0x41, 0x00},     // '{'
+    {0x00, 0x00, 0x7f, 0x00, 0x00},     // '|'
+    {0x00, 0x41, 0x36, 0x08, 0x00},     // '}'
+    {0x08, 0x08, 0x2a, 0x1c, 0x08},     // Right arrow
+    {0x08, 0x1c, 0x2a, 0x08, 0x08}      // Left arrow
+};
+
+// Degree sign 0xdf of the HD44780 character ROM
+static const uint8_t ssd1306_degree[SSD1306_FONT_COLUMNS] PROGMEM = {
+    0x07, 0x05, 0x07, 0x00, 0x00
+};
+
+static uint8_t ssd1306_text[LCD_LINES][LCD_DISP_LENGTH];    // Character of each tile
+static uint16_t ssd1306_dirty[LCD_LINES];       // Tiles not sent yet, bit per column
+static uint8_t ssd1306_cgram[SSD1306_CG_CHARS][SSD1306_CG_ROWS];    // Custom characters
+static uint8_t ssd1306_cg_changed = 0;          // Custom characters not redrawn, bit per character
+static uint8_t ssd1306_cg = SSD1306_DDRAM;      // CGRAM address written by lcd_data()
+static uint8_t ssd1306_x = 0;                   // Cursor
+static uint8_t ssd1306_y = 0;
+static uint8_t ssd1306_display = SSD1306_DISPLAY_OFF;  // Wanted display on/off command
+static uint8_t ssd1306_display_sent = SSD1306_DISPLAY_OFF;
+static uint8_t ssd1306_sent_cmd = 0;            // Display command in last write, 0 if none
+static uint8_t ssd1306_sent_y = 0;              // Line of tiles in last write
+static uint16_t ssd1306_sent = 0;               // Tiles in last write, bit per column
+
+static uint8_t ssd1306_buf[SSD1306_HEADER + LCD_SSD1306_BATCH * SSD1306_TILE];  // Write on the bus
+static twi_trans_t ssd1306_trans = {
+    .address = LCD_SSD1306_ADDRESS
+};
+
+/* Local functions ---------------------------------------------------*/
+/**********************************************************************
+ * Function: ssd1306_column()
+ * Purpose:  Get pixels of one column of character.
+ * Input:    c Character, 0 to 7 are custom characters
+ *           i Column 0 to 4, 0 is on the left
+ * Returns:  Pixels of column, bit 0 is the top row
+ **********************************************************************/
+static uint8_t ssd1306_column(uint8_t c, uint8_t i)
+{
+    uint8_t bits = 0;
+    uint8_t row;
+
+    if (c < SSD1306_CG_CHARS)
+    {
+        // Rows of CGRAM have the left column in bit 4
+        for (row = 0; row < SSD1306_CG_ROWS; row++)
+        {
+            if (ssd1306_cgram[c][row] & (0x10 >> i))
+            {
+                bits |= 1 << row;
+            }
+        }
+        return bits;
+    }
+    if (c >= SSD1306_FONT_FIRST && c < 0x80)
+    {
+        return pgm_read_byte(&ssd1306_font[c - SSD1306_FONT_FIRST][i]);
+    }
+    if (c == 0xdf)
+    {
+        return pgm_read_byte(&ssd1306_degree[i]);
+    }
+    if (c == 0xff)
+    {
+        return 0xff;            /* Full block */
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Function: ssd1306_tile()
+ * Purpose:  Render character as 8 columns of tile, 5 columns of the
+ *           character between one empty column on the left and two
+ *           on the right.
+ * Input:    buf Buffer of SSD1306_TILE bytes
+ *           c Character
+ * Returns:  none
+ **********************************************************************/
+static void ssd1306_tile(uint8_t *buf, uint8_t c)
+{
+    uint8_t i;
+
+    *buf++ = 0;
+    for (i = 0; i < SSD1306_FONT_COLUMNS; i++)
+    {
+        *buf++ = ssd1306_column(c, i);
+    }
+    *buf++ = 0;
+    *buf = 0;
+}
+
+/**********************************************************************
+ * Function: ssd1306_mark_cg()
+ * Purpose:  Mark tiles showing changed custom characters dirty. Called
+ *           with interrupts disabled.
+ * Returns:  none
+ **********************************************************************/
+static void ssd1306_mark_cg(void)
+{
+    uint8_t x, y, c;
+
+    for (y = 0; y < LCD_LINES; y++)
+    {
+        for (x = 0; x < LCD_DISP_LENGTH; x++)
+        {
+            c = ssd1306_text[y][x];
+            if (c < SSD1306_CG_CHARS && (ssd1306_cg_changed & (1 << c)))
+            {
+                ssd1306_dirty[y] |= 1U << x;
+            }
+        }
+    }
+    ssd1306_cg_changed = 0;
+}
+
+/**********************************************************************
+ * Function: ssd1306_failed()
+ * Purpose:  Test whether the last write failed and is not sent again
+ *           yet. Called with interrupts disabled.
+ * Returns:  Non-zero if the write failed
+ **********************************************************************/
+static uint8_t ssd1306_failed(void)
+{
+    return ssd1306_trans.status != TWI_OK && ssd1306_trans.status != TWI_PENDING &&
+           (ssd1306_sent_cmd != 0 || ssd1306_sent != 0);
+}
+
+/**********************************************************************
+ * Function: ssd1306_absent()
+ * Purpose:  Test whether the panel did not acknowledge the last write
+ *           and twi_rescan() has not found it again. Called with
+ *           interrupts disabled.
+ * Returns:  Non-zero if the panel is absent
+ **********************************************************************/
+static uint8_t ssd1306_absent(void)
+{
+    return ssd1306_failed() && ssd1306_trans.status == TWI_ERR_ADDR_NACK &&
+           !twi_dev_present(LCD_SSD1306_ADDRESS);
+}
+
+/**********************************************************************
+ * Function: ssd1306_retry()
+ * Purpose:  Mark tiles and display command of the last write to be
+ *           sent again if the write failed. Called with interrupts
+ *           disabled.
+ * Returns:  none
+ **********************************************************************/
+static void ssd1306_retry(void)
+{
+    if (!ssd1306_failed())
+    {
+        return;
+    }
+    if (ssd1306_sent_cmd != 0 && ssd1306_display_sent == ssd1306_sent_cmd)
+    {
+        ssd1306_display_sent = 0;       /* Differs from both commands */
+    }
+    ssd1306_dirty[ssd1306_sent_y] |= ssd1306_sent;
+    ssd1306_sent_cmd = 0;
+    ssd1306_sent = 0;
+}
+
+/**********************************************************************
+ * Function: ssd1306_busy()
+ * Purpose:  Test whether the panel differs from the tiles in RAM.
+ *           Nothing is sent to an absent panel, so it is not busy.
+ * Returns:  Non-zero if a write is on the bus or not sent yet
+ **********************************************************************/
+static uint8_t ssd1306_busy(void)
+{
+    uint8_t sreg = SREG;
+    uint8_t busy;
+    uint8_t y;
+
+    cli();
+    busy = ssd1306_trans.status == TWI_PENDING || ssd1306_cg_changed != 0 ||
+           ssd1306_display != ssd1306_display_sent || ssd1306_failed();
+    for (y = 0; y < LCD_LINES; y++)
+    {
+        if (ssd1306_dirty[y] != 0)
+        {
+            busy = 1;
+        }
+    }
+    if (ssd1306_absent())
+    {
+        busy = 0;
+    }
+    SREG = sreg;
+    return busy;
+}
+
+/**********************************************************************
+ * Function: ssd1306_write()
+ * Purpose:  Blocking write of command or data bytes, for set-up.
+ * Input:    control SSD1306_CMD or SSD1306_DATA
+ *           buf Bytes, first one is overwritten by control
+ *           len Number of bytes including control
+ * Returns:  none
+ **********************************************************************/
+static void ssd1306_write(uint8_t control, uint8_t *buf, uint8_t len)
+{
+    buf[0] = control;
+    twi_transfer(LCD_SSD1306_ADDRESS, buf, len, NULL, 0);
+}
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: lcd_init()
+ * Purpose:  Set up panel, clear its whole RAM and set display on or
+ *           off. Cursor attributes are ignored.
+ * Input:    dispAttr LCD_DISP_OFF or LCD_DISP_ON
+ * Returns:  none
+ **********************************************************************/
+void lcd_init(uint8_t dispAttr)
+{
+    uint8_t buf[1 + sizeof(ssd1306_setup)]; // Control byte and commands or zeros
+    uint8_t page, i;
+
+    _delay_us(LCD_DELAY_BOOTUP);            /* supply of panel settles */
+
+    memcpy_P(&buf[1], ssd1306_setup, sizeof(ssd1306_setup));
+    ssd1306_write(SSD1306_CMD, buf, 1 + sizeof(ssd1306_setup));
+
+    for (page = 0; page < SSD1306_PAGES; page++)
+    {
+        buf[1] = SSD1306_PAGE | page;
+        buf[2] = SSD1306_COLUMN_LOW;
+        buf[3] = SSD1306_COLUMN_HIGH;
+        ssd1306_write(SSD1306_CMD, buf, 4);
+        memset(&buf[1], 0, SSD1306_CLEAR_CHUNK);
+        for (i = 0; i < SSD1306_WIDTH / SSD1306_CLEAR_CHUNK; i++)
+        {
+            ssd1306_write(SSD1306_DATA, buf, 1 + SSD1306_CLEAR_CHUNK);
+        }
+    }
+
+    // Spaces are empty tiles, so RAM matches the cleared panel
+    memset(ssd1306_text, ' ', sizeof(ssd1306_text));
+    memset(ssd1306_dirty, 0, sizeof(ssd1306_dirty));
+    memset(ssd1306_cgram, 0, sizeof(ssd1306_cgram));
+    ssd1306_cg_changed = 0;
+    ssd1306_display_sent = SSD1306_DISPLAY_OFF;
+    ssd1306_sent_cmd = 0;
+    ssd1306_sent = 0;
+    lcd_command(dispAttr);
+    lcd_home();
+}
+
+/**********************************************************************
+ * Function: lcd_clrscr()
+ * Purpose:  Fill tiles with spaces and set cursor to home position.
+ * Returns:  none
+ **********************************************************************/
+void lcd_clrscr(void)
+{
+    lcd_command(1 << LCD_CLR);
+}
+
+/**********************************************************************
+ * Function: lcd_home()
+ * Purpose:  Set cursor to home position.
+ * Returns:  none
+ **********************************************************************/
+void lcd_home(void)
+{
+    lcd_command(1 << LCD_HOME);
+}
+
+/**********************************************************************
+ * Function: lcd_gotoxy()
+ * Purpose:  Set cursor to tile.
+ * Input:    x Column, 0 is on the left
+ *           y Line, 0 is on the top
+ * Returns:  none
+ **********************************************************************/
+void lcd_gotoxy(uint8_t x, uint8_t y)
+{
+    ssd1306_x = x;
+    ssd1306_y = y;
+    ssd1306_cg = SSD1306_DDRAM;
+}
+
+/**********************************************************************
+ * Function: lcd_getxy()
+ * Purpose:  Get cursor position, there is no address counter to read.
+ * Returns:  Line times LCD_DISP_LENGTH plus column
+ **********************************************************************/
+int lcd_getxy(void)
+{
+    return ssd1306_y * LCD_DISP_LENGTH + ssd1306_x;
+}
+
+/**********************************************************************
+ * Function: lcd_command()
+ * Purpose:  Execute HD44780 instruction on the tiles. DDRAM address is
+ *           y * LCD_DISP_LENGTH + x. Entry mode, shift and function
+ *           set are ignored.
+ * Input:    cmd Instruction, see HD44780 data sheet
+ * Returns:  none
+ **********************************************************************/
+void lcd_command(uint8_t cmd)
+{
+    uint8_t sreg = SREG;
+    uint8_t x, y;
+
+    if (cmd & (1 << LCD_DDRAM))
+    {
+        cmd &= ~(1 << LCD_DDRAM);
+        lcd_gotoxy(cmd % LCD_DISP_LENGTH, cmd / LCD_DISP_LENGTH);
+    }
+    else if (cmd & (1 << LCD_CGRAM))
+    {
+        ssd1306_cg = cmd & ~(1 << LCD_CGRAM);
+    }
+    else if (cmd & ((1 << LCD_FUNCTION) | (1 << LCD_MOVE)))
+    {
+        /* Nothing to do on the panel */
+    }
+    else if (cmd & (1 << LCD_ON))
+    {
+        ssd1306_display = (cmd & (1 << LCD_ON_DISPLAY)) ?
+                          SSD1306_DISPLAY_ON : SSD1306_DISPLAY_OFF;
+    }
+    else if (cmd & (1 << LCD_ENTRY_MODE))
+    {
+        /* Cursor always moves right */
+    }
+    else if (cmd & ((1 << LCD_HOME) | (1 << LCD_CLR)))
+    {
+        if (cmd & (1 << LCD_CLR))
+        {
+            cli();
+            for (y = 0; y < LCD_LINES; y++)
+            {
+                for (x = 0; x < LCD_DISP_LENGTH; x++)
+                {
+                    if (ssd1306_text[y][x] != ' ')
+                    {
+                        ssd1306_text[y][x] = ' ';
+                        ssd1306_dirty[y] |= 1U << x;
+                    }
+                }
+            }
+            SREG = sreg;
+        }
+        lcd_gotoxy(0, 0);
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_data()
+ * Purpose:  Write character to tile at cursor and move cursor right,
+ *           or write row of custom character after a CGRAM address.
+ *           A tile is marked dirty only if its character changes.
+ * Input:    data Character or row of custom character
+ * Returns:  none
+ **********************************************************************/
+void lcd_data(uint8_t data)
+{
+    uint8_t sreg = SREG;
+    uint8_t c, row;
+
+    cli();
+    if (ssd1306_cg != SSD1306_DDRAM)
+    {
+        c = ssd1306_cg / SSD1306_CG_ROWS;
+        row = ssd1306_cg % SSD1306_CG_ROWS;
+        data &= 0x1f;
+        if (ssd1306_cgram[c][row] != data)
+        {
+            ssd1306_cgram[c][row] = data;
+            ssd1306_cg_changed |= 1 << c;
+        }
+        ssd1306_cg = (ssd1306_cg + 1) % (SSD1306_CG_CHARS * SSD1306_CG_ROWS);
+    }
+    else if (ssd1306_x < LCD_DISP_LENGTH)
+    {
+        if (ssd1306_y < LCD_LINES && ssd1306_text[ssd1306_y][ssd1306_x] != data)
+        {
+            ssd1306_text[ssd1306_y][ssd1306_x] = data;
+            ssd1306_dirty[ssd1306_y] |= 1U << ssd1306_x;
+        }
+        ssd1306_x++;            /* Characters right of the panel are lost */
+    }
+    SREG = sreg;
+}
+
+/**********************************************************************
+ * Function: lcd_putc()
+ * Purpose:  Write character at cursor, new line moves to the start of
+ *           the next line.
+ * Input:    c Character
+ * Returns:  none
+ **********************************************************************/
+void lcd_putc(char c)
+{
+    if (c == '\n')
+    {
+        lcd_gotoxy(0, (ssd1306_y + 1 < LCD_LINES) ? ssd1306_y + 1 : 0);
+    }
+    else
+    {
+        lcd_data(c);
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_puts()
+ * Purpose:  Write string at cursor.
+ * Input:    s Terminated string
+ * Returns:  none
+ **********************************************************************/
+void lcd_puts(const char *s)
+{
+    char c;
+
+    while ((c = *s++) != '\0')
+    {
+        lcd_putc(c);
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_puts_p()
+ * Purpose:  Write string from program memory at cursor.
+ * Input:    progmem_s Terminated string in flash
+ * Returns:  none
+ **********************************************************************/
+void lcd_puts_p(const char *progmem_s)
+{
+    char c;
+
+    while ((c = pgm_read_byte(progmem_s++)) != '\0')
+    {
+        lcd_putc(c);
+    }
+}
+
+/**********************************************************************
+ * Function: lcd_queue_free()
+ * Purpose:  Get number of bytes written without waiting.
+ * Returns:  255, lcd_data() only marks tiles dirty and never waits
+ **********************************************************************/
+uint8_t lcd_queue_free(void)
+{
+    return 255;
+}
+
+/**********************************************************************
+ * Function: lcd_tick()
+ * Purpose:  Send display on/off command or up to LCD_SSD1306_BATCH
+ *           consecutive dirty tiles of the first line that has any,
+ *           when the previous write finished. Tiles are rendered from
+ *           the font just before sending. Contents of a failed write
+ *           are sent again.
+ * Returns:  none
+ **********************************************************************/
+void lcd_tick(void)
+{
+    uint8_t sreg = SREG;
+    uint8_t *buf = ssd1306_buf;
+    uint16_t sent = 0;
+    uint8_t x, y;
+
+    cli();
+    if (ssd1306_trans.status == TWI_PENDING)
+    {
+        SREG = sreg;
+        return;                 /* Previous write still on the bus */
+    }
+    if (ssd1306_absent())
+    {
+        SREG = sreg;
+        return;                 /* Failed write is kept until the panel is back */
+    }
+    ssd1306_retry();
+    if (ssd1306_cg_changed != 0)
+    {
+        ssd1306_mark_cg();
+    }
+
+    if (ssd1306_display != ssd1306_display_sent)
+    {
+        buf[0] = SSD1306_CMD;
+        buf[1] = ssd1306_display;
+        ssd1306_trans.tx_buf = buf;
+        ssd1306_trans.tx_len = 2;
+        if (twi_submit(&ssd1306_trans) == 0)    // Else TWI queue full, next tick
+        {
+            ssd1306_display_sent = ssd1306_display;
+            ssd1306_sent_cmd = ssd1306_display;
+            ssd1306_sent = 0;
+        }
+        SREG = sreg;
+        return;
+    }
+
+    for (y = 0; y < LCD_LINES && ssd1306_dirty[y] == 0; y++)
+    {
+    }
+    if (y < LCD_LINES)
+    {
+        for (x = 0; !(ssd1306_dirty[y] & (1U << x)); x++)
+        {
+        }
+        *buf++ = SSD1306_CMD_ONE;
+        *buf++ = SSD1306_PAGE | y;
+        *buf++ = SSD1306_CMD_ONE;
+        *buf++ = SSD1306_COLUMN_LOW | ((x * SSD1306_TILE) & 0x0f);
+        *buf++ = SSD1306_CMD_ONE;
+        *buf++ = SSD1306_COLUMN_HIGH | ((x * SSD1306_TILE) >> 4);
+        *buf++ = SSD1306_DATA;
+        // Column address of the panel advances over the run of tiles
+        while (x < LCD_DISP_LENGTH && (ssd1306_dirty[y] & (1U << x)) &&
+               buf < &ssd1306_buf[sizeof(ssd1306_buf)])
+        {
+            ssd1306_tile(buf, ssd1306_text[y][x]);
+            buf += SSD1306_TILE;
+            sent |= 1U << x;
+            x++;
+        }
+        ssd1306_trans.tx_buf = ssd1306_buf;
+        ssd1306_trans.tx_len = buf - ssd1306_buf;
+        if (twi_submit(&ssd1306_trans) == 0)    // Else TWI queue full, next tick
+        {
+            ssd1306_dirty[y] &= ~sent;
+            ssd1306_sent_cmd = 0;
+            ssd1306_sent_y = y;
+            ssd1306_sent = sent;
+        }
+    }
+    SREG = sreg;
+}
+
+/**********************************************************************
+ * Function: lcd_sync()
+ * Purpose:  Wait until all dirty tiles are sent. With interrupts
+ *           disabled, the writes are sent by polling.
+ * Returns:  none
+ **********************************************************************/
+void lcd_sync(void)
+{
+    while (ssd1306_busy())
+    {
+        // With interrupts disabled the timer interrupt cannot call lcd_tick()
+        if (!(SREG & _BV(SREG_I)))
+        {
+            twi_wait(&ssd1306_trans);   // Services TWI by polling
+            lcd_tick();
+        }
+    }
+}
+
+#endif
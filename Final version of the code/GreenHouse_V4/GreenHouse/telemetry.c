@@ -0,0 +1,116 @@
+/***********************************************************************
+ *
+ * Binary telemetry for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+#include <util/crc16.h>
+#include "uart.h"
+#include "telemetry.h"
+
+/* Defines -----------------------------------------------------------*/
+#define TELEMETRY_RAW_LEN (sizeof(telemetry_t) + 2)     // Record and CRC, max. 254 for one COBS block
+#define TELEMETRY_FRAME_LEN (TELEMETRY_RAW_LEN + 3)     // COBS code byte and two delimiters
+
+/* Variables ---------------------------------------------------------*/
+static uint8_t telemetry_cur_mode = TELEMETRY_MODE;     // Text or binary
+static uint16_t telemetry_seq = 0;                      // Sequence number
+
+/* Function definitions ----------------------------------------------*/
+/**********************************************************************
+ * Function: telemetry_set_mode()
+ * Purpose:  Select text or binary mode.
+ * Input:    mode TELEMETRY_TEXT or TELEMETRY_BINARY
+ * Returns:  none
+ **********************************************************************/
+void telemetry_set_mode(uint8_t mode)
+{
+    telemetry_cur_mode = mode;
+}
+
+/**********************************************************************
+ * Function: telemetry_mode()
+ * Purpose:  Get current mode.
+ * Returns:  TELEMETRY_TEXT or TELEMETRY_BINARY
+ **********************************************************************/
+uint8_t telemetry_mode(void)
+{
+    return telemetry_cur_mode;
+}
+
+/**********************************************************************
+ * Function: telemetry_stamp()
+ * Purpose:  Fill in type, node and next sequence number of new record.
+ * Input:    rec Record
+ * Returns:  none
+ **********************************************************************/
+void telemetry_stamp(telemetry_t *rec)
+{
+    rec->type = TELEMETRY_TYPE_STATUS;
+    rec->node = TELEMETRY_NODE;
+    rec->seq = telemetry_seq++;
+}
+
+/**********************************************************************
+ * Function: telemetry_send()
+ * Purpose:  Append CRC to record, encode it by COBS directly into UART
+ *           transmit buffer and send it.
+ * Input:    rec Record to be sent
+ * Returns:  0 - Frame sent, 1 - Not enough space in UART buffer
+ **********************************************************************/
+uint8_t telemetry_send(const telemetry_t *rec)
+{
+    const uint8_t *p = (const uint8_t *)rec;
+    uart_span_t span;
+    uint16_t crc = 0;
+    uint8_t code_idx = 1;
+    uint8_t out = 2;
+    uint8_t data;
+    uint8_t i;
+
+    /* Whole frame or nothing, a partial frame is useless */
+    if (uart_tx_reserve(&span, TELEMETRY_FRAME_LEN) < TELEMETRY_FRAME_LEN)
+    {
+        return 1;
+    }
+
+    for (i = 0; i < sizeof(telemetry_t); i++)
+    {
+        crc = _crc_xmodem_update(crc, p[i]);
+    }
+
+    /* COBS: every zero is replaced by distance to the next zero */
+    *UART_SPAN_AT(&span, 0) = 0;
+    for (i = 0; i < TELEMETRY_RAW_LEN; i++)
+    {
+        if (i < sizeof(telemetry_t))
+        {
+            data = p[i];
+        }
+        else
+        {
+            data = (i == sizeof(telemetry_t)) ? crc >> 8 : crc & 0xff;
+        }
+
+        if (data == 0)
+        {
+            *UART_SPAN_AT(&span, code_idx) = out - code_idx;
+            code_idx = out++;
+        }
+        else
+        {
+            *UART_SPAN_AT(&span, out) = data;
+            out++;
+        }
+    }
+    *UART_SPAN_AT(&span, code_idx) = out - code_idx;
+    *UART_SPAN_AT(&span, out) = 0;
+
+    uart_tx_commit(out + 1);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#ifndef TELEMETRY_H
+# define TELEMETRY_H
+
+/***********************************************************************
+ * 
+ * Binary telemetry for AVR-GCC.
+ * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
+ *
+ * This work is licensed under the terms of the MIT license.
+ *
+ **********************************************************************/
+
+/**
+ * @file 
+ * @defgroup telemetry Telemetry Library <telemetry.h>
+ * @code #include "telemetry.h" @endcode
+ *
+ * @brief Binary telemetry records sent via UART.
+ *
+ * One record is sent per scan cycle instead of the text messages. The
+ * record, followed by CRC-16/XMODEM of the record (MSB first), is
+ * encoded by COBS (Consistent Overhead Byte Stuffing), so the frame
+ * contains no zero byte. Every frame is enclosed in zero delimiters. A
+ * receiver collects bytes up to a zero, decodes them and checks CRC.
+ * Multi-byte fields of the record are sent LSB first.
+ *
+ * In TELEMETRY_TEXT mode, no frames are sent and the application sends
+ * human-readable text instead.
+ * @{
+ */
+
+
+/* Includes ----------------------------------------------------------*/
+#include <avr/io.h>
+
+
+/* Defines -----------------------------------------------------------*/
+#define TELEMETRY_TEXT 0 /**< @brief Mode: Human-readable text */
+#define TELEMETRY_BINARY 1 /**< @brief Mode: COBS framed binary records */
+#ifndef TELEMETRY_MODE
+# define TELEMETRY_MODE TELEMETRY_TEXT /**< @brief Mode after reset */
+#endif
+#ifndef TELEMETRY_NODE
+# define TELEMETRY_NODE 1 /**< @brief Node id of this controller */
+#endif
+#define TELEMETRY_TYPE_STATUS 0x01 /**< @brief Record type of telemetry_t */
+
+/** @brief Telemetry record of one scan cycle */
+typedef struct {
+    uint8_t type;           /**< @brief TELEMETRY_TYPE_STATUS */
+    uint8_t node;           /**< @brief TELEMETRY_NODE */
+    uint16_t seq;           /**< @brief Sequence number of the record */
+    uint8_t hours;          /**< @brief Time of RTC, BCD */
+    uint8_t minutes;        /**< @brief Time of RTC, BCD */
+    uint8_t seconds;        /**< @brief Time of RTC, BCD */
+    uint16_t adc_moist;     /**< @brief Raw ADC value of soil moisture sensor */
+    uint16_t adc_light;     /**< @brief Raw ADC value of light sensor */
+    int16_t temp;           /**< @brief Average temperature in 0.1 degC */
+    uint8_t relays;         /**< @brief Relay bitmap, bits as in regmap.h */
+} telemetry_t;
+
+
+/* Function prototypes -----------------------------------------------*/
+/**
+ * @name Functions
+ */
+
+/**
+ * @brief  Select text or binary mode.
+ * @param  mode TELEMETRY_TEXT or TELEMETRY_BINARY
+ * @return none
+ */
+void telemetry_set_mode(uint8_t mode);
+
+
+/**
+ * @brief  Get current mode.
+ * @return TELEMETRY_TEXT or TELEMETRY_BINARY
+ */
+uint8_t telemetry_mode(void);
+
+
+/**
+ * @brief  Fill in type, node and next sequence number of a new record.
+ * @param  rec Record, stamped once before it is stored or sent
+ * @return none
+ */
+void telemetry_stamp(telemetry_t *rec);
+
+
+/**
+ * @brief  Send record as one COBS frame. The frame is encoded directly
+ *         into UART transmit buffer, it is sent whole or not at all.
+ *         A record sent again keeps its sequence number.
+ * @param  rec Record stamped by telemetry_stamp()
+ * @retval 0 - Frame sent
+ * @retval 1 - Not enough space in UART transmit buffer, record dropped
+ */
+uint8_t telemetry_send(const telemetry_t *rec);
+
+/** @} */
+
+#endif
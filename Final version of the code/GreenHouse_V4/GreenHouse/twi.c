@@ -1,5 +1,5 @@
 /***********************************************************************
- * 
+ *
  * TWI library for AVR-GCC.
  * ATmega328P (Arduino Uno), 16 MHz, AVR 8-bit Toolchain 3.6.2
  *
@@ -10,8 +10,577 @@
  **********************************************************************/
 
 /* Includes ----------------------------------------------------------*/
+#include <stddef.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/delay.h>
 #include "twi.h"
 
+/* Defines -----------------------------------------------------------*/
+#define TWI_QUEUE_MASK (TWI_QUEUE_SIZE - 1)
+#define TWI_MUX_INDEX(c) (((c) >> 3) & 0x07)
+#define TWI_MUX_MASK(c) (1 << ((c) & 0x07))
+
+/* Variables ---------------------------------------------------------*/
+static twi_trans_t *twi_queue[TWI_QUEUE_SIZE];  // Queued transactions
+static volatile uint8_t twi_q_head = 0;         // Index of next free slot
+static volatile uint8_t twi_q_tail = 0;         // Index of first transaction
+static twi_trans_t * volatile twi_cur = NULL;   // Transaction on the bus
+static uint8_t twi_idx = 0;                     // Byte index in current phase
+static uint8_t twi_tx_total = 0;                // Register and data bytes to write
+static volatile uint8_t twi_locked = 0;         // Bus held by twi_start()
+static uint8_t twi_locked_addr = 0;             // Slave addressed by twi_start()
+static volatile uint8_t twi_steps = 0;          // Incremented on every bus event
+static twi_dev_t twi_devs[TWI_MAX_DEVICES];     // Device registry
+static uint8_t twi_probing = 0;                 // Do not count errors of blocking probes
+static twi_trans_t twi_rescan_trans;            // Probe of absent slave
+static uint8_t twi_mux_sel = TWI_DIRECT;        // Enabled multiplexer channel
+static uint8_t twi_mux_phase = 0;               // 2 - Disable old mux, 1 - Select channel
+static uint8_t twi_mux_lost = 0;                // Write of twi_mux_sel mux failed, rewrite it
+static uint8_t twi_idle_bits = 0;               // TWEA and TWIE kept while idle in slave mode
+static uint8_t twi_restart = 0;                 // Master transaction lost to slave access
+static uint8_t *twi_sl_buf[2];                  // Double buffered slave register map
+static uint8_t twi_sl_len = 0;                  // Size of slave register map
+static volatile uint8_t twi_sl_front = 0;       // Buffer published to masters
+static uint8_t * volatile twi_sl_reading = NULL;    // Buffer latched by ongoing read
+static uint8_t twi_sl_ptr = 0;                  // Register pointer of slave
+static uint8_t twi_sl_first = 0;                // Next received byte is register pointer
+#ifdef TWI_TRACE
+static twi_trace_t twi_trace_buf[TWI_TRACE_SIZE];   // Ring buffer of trace entries
+static volatile uint8_t twi_trace_head = 0;     // Index of next free entry
+static volatile uint8_t twi_trace_tail = 0;     // Index of oldest entry
+static uint8_t twi_trace_overrun = 0;           // Overwritten entries
+static uint16_t twi_trace_start;                // Start time of current transaction
+# define TWI_TRACE_BEGIN() (twi_trace_start = TWI_TRACE_CLOCK)
+# define TWI_TRACE_END(trans, status) twi_trace_add((trans), (status))
+#else
+# define TWI_TRACE_BEGIN()
+# define TWI_TRACE_END(trans, status)
+#endif
+
+/* Local functions ---------------------------------------------------*/
+/**********************************************************************
+ * Function: twi_dev_get()
+ * Purpose:  Find entry of slave device in device table.
+ * Input:    address 7-bit slave address
+ *           create 1 - Use a free entry if the slave is not in table
+ * Returns:  Pointer to entry, NULL if not found or table is full
+ **********************************************************************/
+static twi_dev_t *twi_dev_get(uint8_t address, uint8_t create)
+{
+    twi_dev_t *dev;
+
+    for (dev = twi_devs; dev < twi_devs + TWI_MAX_DEVICES; dev++)
+    {
+        if (dev->address == address)
+        {
+            return dev;
+        }
+        if (dev->address == 0)
+        {
+            break;      /* Entries are allocated in order */
+        }
+    }
+    if (!create || dev == twi_devs + TWI_MAX_DEVICES)
+    {
+        return NULL;
+    }
+    dev->address = address;
+    return dev;
+}
+
+/**********************************************************************
+ * Function: twi_count_error()
+ * Purpose:  Increment error counter of slave device.
+ * Input:    address 7-bit slave address
+ * Returns:  none
+ **********************************************************************/
+static void twi_count_error(uint8_t address)
+{
+    twi_dev_t *dev;
+
+    if (twi_probing)
+    {
+        return;     /* Do not fill the table with missing addresses */
+    }
+    dev = twi_dev_get(address, 1);
+    if (dev != NULL && dev->errors != 0xff)
+    {
+        dev->errors++;
+    }
+}
+
+/**********************************************************************
+ * Function: twi_dev_update()
+ * Purpose:  Update registry entry by result of finished transaction.
+ * Input:    trans Finished transaction
+ *           status Final status of transaction
+ * Returns:  none
+ **********************************************************************/
+static void twi_dev_update(const twi_trans_t *trans, uint8_t status)
+{
+    twi_dev_t *dev;
+
+    if (status != TWI_OK && trans != &twi_rescan_trans)
+    {
+        twi_count_error(trans->address);
+    }
+
+    /* Presence behind multiplexer is not a property of the address */
+    dev = twi_dev_get(trans->address, 0);
+    if (dev != NULL && trans->channel == TWI_DIRECT)
+    {
+        if (status == TWI_OK)
+        {
+            dev->flags |= TWI_DEV_PRESENT;
+        }
+        else if (status == TWI_ERR_ADDR_NACK)
+        {
+            dev->flags &= ~TWI_DEV_PRESENT;
+        }
+    }
+}
+
+#ifdef TWI_TRACE
+/**********************************************************************
+ * Function: twi_trace_add()
+ * Purpose:  Record finished transaction to trace buffer.
+ * Input:    trans Finished transaction
+ *           status Final status of transaction
+ * Returns:  none
+ **********************************************************************/
+static void twi_trace_add(const twi_trans_t *trans, uint8_t status)
+{
+    twi_trace_t *entry = &twi_trace_buf[twi_trace_head];
+
+    entry->start = twi_trace_start;
+    entry->end = TWI_TRACE_CLOCK;
+    entry->address = trans->address;
+    entry->len = trans->reg_len + trans->tx_len + trans->rx_len;
+    entry->status = status;
+    twi_trace_head = (twi_trace_head + 1) & (TWI_TRACE_SIZE - 1);
+    if (twi_trace_head == twi_trace_tail)
+    {
+        /* Buffer is full, drop the oldest entry */
+        twi_trace_tail = (twi_trace_tail + 1) & (TWI_TRACE_SIZE - 1);
+        if (twi_trace_overrun != 0xff)
+        {
+            twi_trace_overrun++;
+        }
+    }
+}
+#endif
+
+/**********************************************************************
+ * Function: twi_wait_stop()
+ * Purpose:  Wait until STOP condition is transmitted.
+ * Returns:  none
+ **********************************************************************/
+static void twi_wait_stop(void)
+{
+    uint16_t loops = 0;
+
+    while ((TWCR & _BV(TWSTO)) && ++loops < TWI_TIMEOUT_LOOPS);
+    if (loops >= TWI_TIMEOUT_LOOPS)
+    {
+        twi_recover();
+    }
+}
+
+/**********************************************************************
+ * Function: twi_bit_rate()
+ * Purpose:  Program SCL frequency of slave device. When the frequency
+ *           changes, pending STOP is transmitted at the old frequency.
+ * Input:    address 7-bit slave address
+ *           stop 1 - STOP condition is to be generated
+ * Returns:  STOP condition still to be generated
+ **********************************************************************/
+static uint8_t twi_bit_rate(uint8_t address, uint8_t stop)
+{
+    const twi_dev_t *dev = twi_dev_get(address, 0);
+    uint8_t twbr = TWI_BIT_RATE_REG;
+    uint8_t twps = 0;
+
+    if (dev != NULL && dev->scl_khz != 0)
+    {
+        twbr = dev->twbr;
+        twps = dev->twps;
+    }
+    if (TWBR != twbr || (TWSR & 0x03) != twps)
+    {
+        if (stop)
+        {
+            TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
+            twi_wait_stop();
+            stop = 0;
+        }
+        TWSR = twps;
+        TWBR = twbr;
+    }
+    return stop;
+}
+
+/**********************************************************************
+ * Function: twi_start_next()
+ * Purpose:  Generate START condition for the transaction in twi_cur.
+ * Input:    stop 1 - Generate STOP condition before START
+ * Returns:  none
+ **********************************************************************/
+static void twi_start_next(uint8_t stop)
+{
+    uint8_t channel = twi_cur->channel;
+
+    /* Multiplexer is written first when the channel changes */
+    twi_mux_phase = 0;
+    if (channel != TWI_DIRECT && (channel != twi_mux_sel || twi_mux_lost))
+    {
+        twi_mux_phase = ((twi_mux_sel & 0x80) &&
+                         TWI_MUX_INDEX(twi_mux_sel) != TWI_MUX_INDEX(channel)) ? 2 : 1;
+    }
+    twi_tx_total = twi_cur->reg_len + twi_cur->tx_len;
+
+    stop = twi_bit_rate(twi_cur->address, stop);
+    twi_idx = 0;
+    TWI_TRACE_BEGIN();
+    TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE) | twi_idle_bits |
+           (stop ? _BV(TWSTO) : 0);
+}
+
+/**********************************************************************
+ * Function: twi_slave_service()
+ * Purpose:  One step of slave mode. Master reads the register map from
+ *           the register pointer, which is set by the first written
+ *           byte. Other written bytes are ignored.
+ * Input:    code Slave status code of TWSR
+ * Returns:  none
+ **********************************************************************/
+static void twi_slave_service(uint8_t code)
+{
+    uint8_t end = 0;
+
+    switch (code)
+    {
+    case 0x68:  /* Arbitration lost, own SLA+W has been received */
+        twi_restart = (twi_cur != NULL);
+        /* fall through */
+    case 0x60:  /* Own SLA+W has been received, ACK returned */
+        twi_sl_first = 1;
+        break;
+
+    case 0x80:  /* Data byte has been received, ACK returned */
+    case 0x88:  /* Data byte has been received, NACK returned */
+        if (twi_sl_first)
+        {
+            twi_sl_ptr = TWDR;
+            twi_sl_first = 0;
+        }
+        break;
+
+    case 0xb0:  /* Arbitration lost, own SLA+R has been received */
+        twi_restart = (twi_cur != NULL);
+        /* fall through */
+    case 0xa8:  /* Own SLA+R has been received, ACK returned */
+        /* The whole read comes from one buffer */
+        twi_sl_reading = twi_sl_buf[twi_sl_front];
+        /* fall through */
+    case 0xb8:  /* Data byte has been transmitted, ACK received */
+        TWDR = (twi_sl_ptr < twi_sl_len) ? twi_sl_reading[twi_sl_ptr] : 0xff;
+        twi_sl_ptr++;
+        break;
+
+    default:    /* 0xa0: STOP or repeated START, 0xc0, 0xc8: End of read */
+        twi_sl_reading = NULL;
+        end = 1;
+        break;
+    }
+
+    /* Master transaction interrupted by slave access starts again */
+    if (end && twi_restart && twi_cur != NULL)
+    {
+        twi_restart = 0;
+        twi_start_next(0);
+    }
+    else
+    {
+        TWCR = _BV(TWINT) | _BV(TWEN) | twi_idle_bits;
+    }
+}
+
+/**********************************************************************
+ * Function: twi_finish()
+ * Purpose:  Close current transaction and start the next queued one.
+ * Input:    status Final status of current transaction
+ *           stop 1 - Generate STOP condition, 0 - only release the bus
+ * Returns:  none
+ **********************************************************************/
+static void twi_finish(uint8_t status, uint8_t stop)
+{
+    twi_trans_t *done = twi_cur;
+    void (*callback)(twi_trans_t *) = done->callback;
+
+    twi_q_tail = (twi_q_tail + 1) & TWI_QUEUE_MASK;
+    twi_cur = (twi_q_head != twi_q_tail) ? twi_queue[twi_q_tail] : NULL;
+    twi_idx = 0;
+    twi_dev_update(done, status);
+    TWI_TRACE_END(done, status);
+    if (twi_mux_phase != 0)
+    {
+        /* Multiplexer that acknowledged its address may have taken the
+         * control byte, it is disabled or rewritten by the next select
+         */
+        if (status != TWI_ERR_ADDR_NACK)
+        {
+            if (twi_mux_phase == 1)
+            {
+                twi_mux_sel = done->channel;
+            }
+            twi_mux_lost = 1;
+        }
+        twi_mux_phase = 0;
+    }
+
+    /* STOP and START can be requested together, STOP goes first */
+    if (twi_cur != NULL)
+    {
+        twi_start_next(stop);
+    }
+    else
+    {
+        TWCR = _BV(TWINT) | _BV(TWEN) | twi_idle_bits | (stop ? _BV(TWSTO) : 0);
+    }
+
+    done->status = status;
+    if (callback != NULL)
+    {
+        callback(done);
+    }
+}
+
+/**********************************************************************
+ * Function: twi_service()
+ * Purpose:  One step of the transaction state machine. Called when
+ *           TWINT flag is set, from TWI interrupt or by polling.
+ * Returns:  none
+ **********************************************************************/
+static void twi_service(void)
+{
+    twi_trans_t *t = twi_cur;
+    uint8_t code = TWSR & 0xf8;
+
+    twi_steps++;
+    if (code >= 0x60 && code <= 0xc8)
+    {
+        twi_slave_service(code);
+        return;
+    }
+    if (t == NULL)
+    {
+        TWCR = _BV(TWINT) | _BV(TWEN) | twi_idle_bits;
+        return;
+    }
+
+    /* Master steps keep TWEA of slave mode, so own SLA+R/W is recognized
+     * when arbitration is lost (0x68, 0xb0). After SLA+R is acknowledged,
+     * TWEA acknowledges received data instead.
+     */
+    switch (code)
+    {
+    case 0x08:  /* START has been transmitted */
+    case 0x10:  /* Repeated START has been transmitted */
+        if (twi_mux_phase != 0)
+        {
+            TWDR = ((TWI_MUX_ADDRESS + TWI_MUX_INDEX((twi_mux_phase == 2) ?
+                     twi_mux_sel : t->channel)) << 1) | TWI_WRITE;
+        }
+        else if (twi_idx < twi_tx_total || t->rx_len == 0)
+        {
+            TWDR = (t->address << 1) | TWI_WRITE;
+        }
+        else
+        {
+            TWDR = (t->address << 1) | TWI_READ;
+        }
+        TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE) | twi_idle_bits;
+        break;
+
+    case 0x18:  /* SLA+W has been transmitted, ACK received */
+    case 0x28:  /* Data byte has been transmitted, ACK received */
+        if (twi_mux_phase != 0)
+        {
+            if (twi_idx == 0)
+            {
+                /* Control register of multiplexer */
+                TWDR = (twi_mux_phase == 2) ? 0 : TWI_MUX_MASK(t->channel);
+                twi_idx++;
+                TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE) | twi_idle_bits;
+            }
+            else
+            {
+                /* New selection becomes active after STOP */
+                twi_mux_sel = (twi_mux_phase == 2) ? TWI_DIRECT : t->channel;
+                twi_mux_lost = 0;
+                twi_mux_phase--;
+                twi_idx = 0;
+                TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE) |
+                       twi_idle_bits;
+            }
+        }
+        else if (twi_idx < twi_tx_total)
+        {
+            TWDR = (twi_idx < t->reg_len) ? t->reg : t->tx_buf[twi_idx - t->reg_len];
+            twi_idx++;
+            TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE) | twi_idle_bits;
+        }
+        else if (t->rx_len != 0)
+        {
+            TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE) | twi_idle_bits;
+        }
+        else
+        {
+            twi_finish(TWI_OK, 1);
+        }
+        break;
+
+    case 0x30:  /* Data byte has been transmitted, NACK received */
+        if (twi_mux_phase == 0 && twi_idx == twi_tx_total && t->rx_len == 0)
+        {
+            twi_finish(TWI_OK, 1);     /* Slave may NACK the last byte */
+        }
+        else
+        {
+            twi_finish(TWI_ERR_DATA_NACK, 1);
+        }
+        break;
+
+    case 0x20:  /* SLA+W has been transmitted, NACK received */
+    case 0x48:  /* SLA+R has been transmitted, NACK received */
+        twi_finish(TWI_ERR_ADDR_NACK, 1);
+        break;
+
+    case 0x38:  /* Arbitration lost */
+        twi_finish(TWI_ERR_ARB_LOST, 0);
+        break;
+
+    case 0x40:  /* SLA+R has been transmitted, ACK received */
+        twi_idx = 0;
+        TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE) |
+               ((t->rx_len > 1) ? _BV(TWEA) : 0);
+        break;
+
+    case 0x50:  /* Data byte has been received, ACK returned */
+        t->rx_buf[twi_idx++] = TWDR;
+        TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE) |
+               ((twi_idx < t->rx_len - 1) ? _BV(TWEA) : 0);
+        break;
+
+    case 0x58:  /* Data byte has been received, NACK returned */
+        t->rx_buf[twi_idx] = TWDR;
+        twi_finish(TWI_OK, 1);
+        break;
+
+    default:    /* 0x00: Bus error */
+        twi_finish(TWI_ERR_BUS, 1);
+        break;
+    }
+}
+
+/**********************************************************************
+ * Function: twi_poll()
+ * Purpose:  Service the engine by polling if TWI interrupt cannot be
+ *           executed because global interrupts are disabled.
+ * Returns:  none
+ **********************************************************************/
+static void twi_poll(void)
+{
+    if (((SREG & _BV(SREG_I)) == 0) && (TWCR & _BV(TWINT)))
+    {
+        twi_service();
+    }
+}
+
+/**********************************************************************
+ * Function: twi_abort()
+ * Purpose:  Abort current transaction, recover the bus and start the
+ *           next queued transaction.
+ * Input:    status Final status of aborted transaction
+ * Returns:  none
+ **********************************************************************/
+static void twi_abort(uint8_t status)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (twi_cur != NULL)
+        {
+            twi_recover();
+            twi_finish(status, 0);
+        }
+    }
+}
+
+/**********************************************************************
+ * Function: twi_watch()
+ * Purpose:  One iteration of a wait loop. Service the engine by polling
+ *           and abort current transaction if the bus does not move.
+ * Input:    steps Value of twi_steps seen by the previous iteration
+ *           loops Number of iterations without bus progress
+ * Returns:  none
+ **********************************************************************/
+static void twi_watch(uint8_t *steps, uint16_t *loops)
+{
+    twi_poll();
+    if (*steps != twi_steps)
+    {
+        *steps = twi_steps;
+        *loops = 0;
+    }
+    else if (++(*loops) >= TWI_TIMEOUT_LOOPS)
+    {
+        twi_abort(TWI_ERR_TIMEOUT);
+        *loops = 0;
+    }
+}
+
+/**********************************************************************
+ * Function: twi_wait_twint()
+ * Purpose:  Wait for TWINT flag in blocking byte-level functions.
+ * Returns:  0 - TWINT flag set
+ *           TWI_ERR_TIMEOUT - Bus did not move, bus was recovered
+ **********************************************************************/
+static uint8_t twi_wait_twint(void)
+{
+    uint16_t loops = 0;
+
+    while ((TWCR & _BV(TWINT)) == 0)
+    {
+        if (++loops >= TWI_TIMEOUT_LOOPS)
+        {
+            twi_recover();
+            twi_count_error(twi_locked_addr);
+            return TWI_ERR_TIMEOUT;
+        }
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Function: twi_run()
+ * Purpose:  Queue transaction, wait for free slot if necessary, and
+ *           wait until transaction finishes.
+ * Input:    trans Transaction descriptor
+ * Returns:  Final status of transaction
+ **********************************************************************/
+static uint8_t twi_run(twi_trans_t *trans)
+{
+    uint8_t steps = twi_steps;
+    uint16_t loops = 0;
+
+    while (twi_submit(trans) != 0)
+    {
+        twi_watch(&steps, &loops);  /* Queue is full, wait for free slot */
+    }
+    return twi_wait(trans);
+}
+
 /* Functions ---------------------------------------------------------*/
 /**********************************************************************
  * Function: twi_init()
@@ -34,20 +603,43 @@ void twi_init(void)
  * Purpose:  Start communication on TWI bus and send address of TWI slave.
  * Input:    slave_address SLA+R or SLA+W address
  * Returns:  0 - Slave device accessible
- *           1 - Failed to access slave device
+ *           >0 - Failed to access slave device, see twi_status_t
  **********************************************************************/
 uint8_t twi_start(uint8_t slave_address)
 {
     uint8_t twi_response;
+    uint8_t steps = twi_steps;
+    uint16_t loops = 0;
+
+    /* Wait for queued transactions and hold the bus until twi_stop() */
+    while (!twi_locked)
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            if (twi_cur == NULL)
+            {
+                twi_locked = 1;
+            }
+        }
+        twi_watch(&steps, &loops);
+    }
+    twi_locked_addr = slave_address >> 1;
+    twi_bit_rate(twi_locked_addr, 0);
 
     /* Generate start condition on TWI bus */
     TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);
-    while ((TWCR & _BV(TWINT)) == 0);
+    if (twi_wait_twint() != 0)
+    {
+        return TWI_ERR_TIMEOUT;
+    }
 
     /* Send SLA+R or SLA+W frame on TWI bus */
     TWDR = slave_address;
     TWCR = _BV(TWINT) | _BV(TWEN);
-    while ((TWCR & _BV(TWINT)) == 0);
+    if (twi_wait_twint() != 0)
+    {
+        return TWI_ERR_TIMEOUT;
+    }
 
     /* Check TWI Status Register and mask TWI prescaler bits */
     twi_response = TWSR & 0xf8;
@@ -60,7 +652,8 @@ uint8_t twi_start(uint8_t slave_address)
     }
     else
     {
-        return 1;   /* Failed to access slave device */
+        twi_count_error(twi_locked_addr);
+        return (twi_response == 0x38) ? TWI_ERR_ARB_LOST : TWI_ERR_ADDR_NACK;
     }
 }
 
@@ -68,39 +661,55 @@ uint8_t twi_start(uint8_t slave_address)
  * Function: twi_write()
  * Purpose:  Send one data byte to TWI slave device.
  * Input:    data Byte to be transmitted
- * Returns:  none
+ * Returns:  0 - Byte transmitted
+ *           >0 - Failed, see twi_status_t
  **********************************************************************/
-void twi_write(uint8_t data)
+uint8_t twi_write(uint8_t data)
 {
     TWDR = data;
     TWCR = _BV(TWINT) | _BV(TWEN);
 
-    while ((TWCR & _BV(TWINT)) == 0);
+    if (twi_wait_twint() != 0)
+    {
+        return TWI_ERR_TIMEOUT;
+    }
+    if ((TWSR & 0xf8) != 0x28)
+    {
+        twi_count_error(twi_locked_addr);
+        return TWI_ERR_DATA_NACK;
+    }
+    return 0;
 }
 
 /**********************************************************************
  * Function: twi_read_ack()
  * Purpose:  Read one byte from TWI slave device and acknowledge it by ACK.
- * Returns:  Received data byte
+ * Returns:  Received data byte, 0xff after timeout
  **********************************************************************/
 uint8_t twi_read_ack(void)
 {
     TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWEA);
 
-    while ((TWCR & _BV(TWINT)) == 0);
+    if (twi_wait_twint() != 0)
+    {
+        return 0xff;
+    }
     return (TWDR);
 }
 
 /**********************************************************************
  * Function: twi_read_nack()
  * Purpose:  Read one byte from TWI slave device and acknowledge it by NACK.
- * Returns:  Received data byte
+ * Returns:  Received data byte, 0xff after timeout
  **********************************************************************/
 uint8_t twi_read_nack(void)
 {
     TWCR = _BV(TWINT) | _BV(TWEN);
 
-    while ((TWCR & _BV(TWINT)) == 0);
+    if (twi_wait_twint() != 0)
+    {
+        return 0xff;
+    }
     return (TWDR);
 }
 
@@ -111,5 +720,504 @@ uint8_t twi_read_nack(void)
  **********************************************************************/
 void twi_stop(void)
 {
-    TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (!twi_locked)
+        {
+            return;     /* Bus is driven by the transaction engine */
+        }
+        twi_locked = 0;
+
+        /* Transactions queued meanwhile start right after STOP */
+        if (twi_q_head != twi_q_tail)
+        {
+            twi_cur = twi_queue[twi_q_tail];
+            twi_start_next(1);
+        }
+        else
+        {
+            TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN) | twi_idle_bits;
+        }
+    }
+}
+
+/**********************************************************************
+ * Function: twi_submit()
+ * Purpose:  Queue a transaction and return immediately.
+ * Input:    trans Transaction descriptor
+ * Returns:  0 - Transaction queued
+ *           1 - Queue is full
+ **********************************************************************/
+uint8_t twi_submit(twi_trans_t *trans)
+{
+    uint8_t tmphead;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        tmphead = (twi_q_head + 1) & TWI_QUEUE_MASK;
+        if (tmphead == twi_q_tail)
+        {
+            return 1;   /* Queue is full */
+        }
+
+        trans->status = TWI_PENDING;
+        twi_queue[twi_q_head] = trans;
+        twi_q_head = tmphead;
+
+        /* Engine is idle, generate START condition after previous STOP */
+        if (twi_cur == NULL && !twi_locked)
+        {
+            twi_wait_stop();
+            twi_cur = trans;
+            twi_start_next(0);
+        }
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Function: twi_wait()
+ * Purpose:  Wait until transaction finishes.
+ * Input:    trans Transaction descriptor passed to twi_submit()
+ * Returns:  Final status of transaction
+ **********************************************************************/
+uint8_t twi_wait(twi_trans_t *trans)
+{
+    uint8_t steps = twi_steps;
+    uint16_t loops = 0;
+
+    while (trans->status == TWI_PENDING)
+    {
+        twi_watch(&steps, &loops);
+    }
+    return trans->status;
+}
+
+/**********************************************************************
+ * Function: twi_transfer()
+ * Purpose:  Blocking write/read transaction.
+ * Input:    address 7-bit slave address
+ *           tx_buf, tx_len Bytes to be written
+ *           rx_buf, rx_len Buffer for received bytes
+ * Returns:  Final status of transaction
+ **********************************************************************/
+uint8_t twi_transfer(uint8_t address, const uint8_t *tx_buf, uint8_t tx_len,
+                     uint8_t *rx_buf, uint8_t rx_len)
+{
+    twi_trans_t trans = {
+        .address = address,
+        .tx_buf = tx_buf,
+        .tx_len = tx_len,
+        .rx_buf = rx_buf,
+        .rx_len = rx_len,
+        .callback = NULL
+    };
+
+    return twi_run(&trans);
+}
+
+/**********************************************************************
+ * Function: twi_read_regs()
+ * Purpose:  Burst read of consecutive slave registers.
+ * Input:    address 7-bit slave address
+ *           reg Address of the first register
+ *           buf, len Buffer for received bytes
+ * Returns:  Final status of transaction
+ **********************************************************************/
+uint8_t twi_read_regs(uint8_t address, uint8_t reg, uint8_t *buf, uint8_t len)
+{
+    twi_trans_t trans = {
+        .address = address,
+        .reg_len = 1,
+        .reg = reg,
+        .rx_buf = buf,
+        .rx_len = len,
+        .callback = NULL
+    };
+
+    return twi_run(&trans);
+}
+
+/**********************************************************************
+ * Function: twi_write_regs()
+ * Purpose:  Burst write of consecutive slave registers.
+ * Input:    address 7-bit slave address
+ *           reg Address of the first register
+ *           buf, len Bytes to be written
+ * Returns:  Final status of transaction
+ **********************************************************************/
+uint8_t twi_write_regs(uint8_t address, uint8_t reg, const uint8_t *buf, uint8_t len)
+{
+    twi_trans_t trans = {
+        .address = address,
+        .reg_len = 1,
+        .reg = reg,
+        .tx_buf = buf,
+        .tx_len = len,
+        .callback = NULL
+    };
+
+    return twi_run(&trans);
+}
+
+/**********************************************************************
+ * Function: twi_idle()
+ * Purpose:  Test whether the transaction engine is idle.
+ * Returns:  1 - Engine is idle, 0 - Engine is busy
+ **********************************************************************/
+uint8_t twi_idle(void)
+{
+    return (twi_cur == NULL);
+}
+
+/**********************************************************************
+ * Function: twi_tick()
+ * Purpose:  Abort transaction which has not moved since previous call.
+ * Returns:  none
+ **********************************************************************/
+void twi_tick(void)
+{
+    static twi_trans_t *last_trans = NULL;
+    static uint8_t last_steps = 0;
+
+    if (twi_cur != NULL && twi_cur == last_trans && twi_steps == last_steps)
+    {
+        twi_abort(TWI_ERR_TIMEOUT);
+    }
+    last_trans = twi_cur;
+    last_steps = twi_steps;
+}
+
+/**********************************************************************
+ * Function: twi_recover()
+ * Purpose:  Release stuck slave by nine SCL pulses and STOP condition,
+ *           and reinitialize TWI module.
+ * Returns:  none
+ **********************************************************************/
+void twi_recover(void)
+{
+    uint8_t i;
+
+    /* Disconnect TWI module, SCL and SDA are driven as open-drain pins
+       with internal pull-ups */
+    TWCR = 0;
+    DDR(TWI_PORT) &= ~(_BV(TWI_SDA_PIN) | _BV(TWI_SCL_PIN));
+    TWI_PORT |= _BV(TWI_SDA_PIN) | _BV(TWI_SCL_PIN);
+
+    /* Clock SCL until the slave finishes its byte and releases SDA */
+    for (i = 0; i < 9 && (PIN(TWI_PORT) & _BV(TWI_SDA_PIN)) == 0; i++)
+    {
+        TWI_PORT &= ~_BV(TWI_SCL_PIN);          /* SCL low */
+        DDR(TWI_PORT) |= _BV(TWI_SCL_PIN);
+        _delay_us(TWI_HALF_PERIOD_US);
+        DDR(TWI_PORT) &= ~_BV(TWI_SCL_PIN);     /* SCL released */
+        TWI_PORT |= _BV(TWI_SCL_PIN);
+        _delay_us(TWI_HALF_PERIOD_US);
+    }
+
+    /* STOP condition: SDA goes high while SCL is high */
+    TWI_PORT &= ~(_BV(TWI_SDA_PIN) | _BV(TWI_SCL_PIN));
+    DDR(TWI_PORT) |= _BV(TWI_SCL_PIN);          /* SCL low */
+    DDR(TWI_PORT) |= _BV(TWI_SDA_PIN);          /* SDA low */
+    _delay_us(TWI_HALF_PERIOD_US);
+    DDR(TWI_PORT) &= ~_BV(TWI_SCL_PIN);         /* SCL released */
+    TWI_PORT |= _BV(TWI_SCL_PIN);
+    _delay_us(TWI_HALF_PERIOD_US);
+    DDR(TWI_PORT) &= ~_BV(TWI_SDA_PIN);         /* SDA released */
+    TWI_PORT |= _BV(TWI_SDA_PIN);
+    _delay_us(TWI_HALF_PERIOD_US);
+
+    /* Enable pull-ups and bit rate again */
+    twi_init();
+    TWCR = _BV(TWEN) | twi_idle_bits;
+}
+
+/**********************************************************************
+ * Function: twi_dev_set_speed()
+ * Purpose:  Set SCL frequency used for slave device.
+ * Input:    address 7-bit slave address
+ *           scl_khz SCL frequency in kHz, 0 - Default F_SCL
+ * Returns:  0 - Frequency set
+ *           1 - Device table is full
+ **********************************************************************/
+uint8_t twi_dev_set_speed(uint8_t address, uint16_t scl_khz)
+{
+    twi_dev_t *dev = twi_dev_get(address, 1);
+    uint32_t div;
+    uint8_t twps;
+
+    if (dev == NULL)
+    {
+        return 1;
+    }
+
+    /* fscl = fcpu/(16 + 2*TWBR*4^TWPS), find the smallest prescaler */
+    div = (scl_khz != 0) ? F_CPU / (1000UL * scl_khz) : F_CPU / F_SCL;
+    div = (div > 16) ? (div - 16) / 2 : 0;
+    for (twps = 0; twps < 3 && div > 255; twps++)
+    {
+        div = div / 4;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        dev->twbr = (div > 255) ? 255 : div;
+        dev->twps = twps;
+        dev->scl_khz = scl_khz;
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Function: twi_dev_probe()
+ * Purpose:  Find the highest SCL frequency at which the slave reliably
+ *           acknowledges its address, and use it for the slave.
+ * Input:    address 7-bit slave address
+ *           max_khz Maximal SCL frequency of the slave in kHz
+ * Returns:  Selected SCL frequency in kHz, 0 - Slave not found
+ **********************************************************************/
+uint16_t twi_dev_probe(uint8_t address, uint16_t max_khz)
+{
+    static const uint16_t speeds[] = {400, 100, F_SCL / 1000};
+    uint8_t i, n;
+
+    for (i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+    {
+        if (speeds[i] > max_khz || twi_dev_set_speed(address, speeds[i]) != 0)
+        {
+            continue;
+        }
+        for (n = 0; n < TWI_PROBE_COUNT; n++)
+        {
+            if (twi_probe(address, TWI_DIRECT) != TWI_OK)
+            {
+                break;
+            }
+        }
+        if (n == TWI_PROBE_COUNT)
+        {
+            return speeds[i];
+        }
+    }
+    twi_dev_set_speed(address, 0);
+    return 0;
+}
+
+/**********************************************************************
+ * Function: twi_probe()
+ * Purpose:  Test whether the slave acknowledges its address.
+ * Input:    address 7-bit slave address
+ *           channel Multiplexer channel or TWI_DIRECT
+ * Returns:  Transaction status
+ **********************************************************************/
+uint8_t twi_probe(uint8_t address, uint8_t channel)
+{
+    twi_trans_t trans = {
+        .address = address,
+        .channel = channel,
+        .callback = NULL
+    };
+    uint8_t probing = twi_probing;
+    uint8_t status;
+
+    twi_probing = 1;
+    status = twi_run(&trans);
+    twi_probing = probing;
+    return status;
+}
+
+/**********************************************************************
+ * Function: twi_enumerate()
+ * Purpose:  Probe all addresses of the main bus and build registry.
+ * Returns:  Number of slaves found
+ **********************************************************************/
+uint8_t twi_enumerate(void)
+{
+    uint8_t address;
+    uint8_t found = 0;
+    twi_dev_t *dev;
+
+    for (address = TWI_FIRST_ADDRESS; address <= TWI_LAST_ADDRESS; address++)
+    {
+        if (twi_probe(address, TWI_DIRECT) == TWI_OK)
+        {
+            found++;
+            dev = twi_dev_get(address, 1);
+            if (dev != NULL)
+            {
+                dev->flags |= TWI_DEV_PRESENT;
+                if ((uint8_t)(address - TWI_MUX_ADDRESS) < 8)
+                {
+                    dev->flags |= TWI_DEV_MUX;
+                }
+            }
+        }
+        else if ((dev = twi_dev_get(address, 0)) != NULL)
+        {
+            dev->flags &= ~TWI_DEV_PRESENT;
+        }
+    }
+    return found;
+}
+
+/**********************************************************************
+ * Function: twi_dev_present()
+ * Purpose:  Test whether registered slave is present.
+ * Input:    address 7-bit slave address
+ * Returns:  1 - Present, 0 - Absent or not registered
+ **********************************************************************/
+uint8_t twi_dev_present(uint8_t address)
+{
+    const twi_dev_t *dev = twi_dev_get(address, 0);
+
+    return dev != NULL && (dev->flags & TWI_DEV_PRESENT);
+}
+
+/**********************************************************************
+ * Function: twi_rescan()
+ * Purpose:  Queue probe of the next absent slave in registry.
+ * Returns:  none
+ **********************************************************************/
+void twi_rescan(void)
+{
+    static uint8_t index = 0;
+    const twi_dev_t *dev;
+    uint8_t n;
+
+    if (twi_rescan_trans.status == TWI_PENDING)
+    {
+        return;
+    }
+    for (n = 0; n < TWI_MAX_DEVICES; n++)
+    {
+        dev = &twi_devs[index];
+        index = (index + 1) % TWI_MAX_DEVICES;
+        if (dev->address != 0 && !(dev->flags & TWI_DEV_PRESENT))
+        {
+            twi_rescan_trans.address = dev->address;
+            twi_submit(&twi_rescan_trans);
+            return;
+        }
+    }
+}
+
+/**********************************************************************
+ * Function: twi_slave_init()
+ * Purpose:  Respond to masters as slave with read-only register map.
+ * Input:    address Own 7-bit slave address
+ *           buf0, buf1 Two buffers of register map
+ *           len Size of register map in bytes
+ * Returns:  none
+ **********************************************************************/
+void twi_slave_init(uint8_t address, uint8_t *buf0, uint8_t *buf1, uint8_t len)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        twi_sl_buf[0] = buf0;
+        twi_sl_buf[1] = buf1;
+        twi_sl_len = len;
+        twi_sl_front = 0;
+        TWAR = address << 1;
+        twi_idle_bits = _BV(TWEA) | _BV(TWIE);
+        if (twi_cur == NULL && !twi_locked)
+        {
+            TWCR = _BV(TWEN) | twi_idle_bits;
+        }
+    }
+}
+
+/**********************************************************************
+ * Function: twi_slave_back()
+ * Purpose:  Get buffer of register map which is not published.
+ * Returns:  Pointer to buffer, NULL if a master is still reading it
+ **********************************************************************/
+uint8_t *twi_slave_back(void)
+{
+    uint8_t *back;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        back = twi_sl_buf[twi_sl_front ^ 1];
+        if (back == twi_sl_reading)
+        {
+            back = NULL;
+        }
+    }
+    return back;
+}
+
+/**********************************************************************
+ * Function: twi_slave_publish()
+ * Purpose:  Swap buffers of register map, so that reads which start
+ *           from now on return the buffer filled by the application.
+ * Returns:  none
+ **********************************************************************/
+void twi_slave_publish(void)
+{
+    twi_sl_front ^= 1;
+}
+
+#ifdef TWI_TRACE
+/**********************************************************************
+ * Function: twi_trace_read()
+ * Purpose:  Remove the oldest entry from trace buffer.
+ * Input:    entry Copy of the entry
+ * Returns:  1 - Entry copied, 0 - Buffer is empty
+ **********************************************************************/
+uint8_t twi_trace_read(twi_trace_t *entry)
+{
+    uint8_t ret = 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (twi_trace_tail != twi_trace_head)
+        {
+            *entry = twi_trace_buf[twi_trace_tail];
+            twi_trace_tail = (twi_trace_tail + 1) & (TWI_TRACE_SIZE - 1);
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+/**********************************************************************
+ * Function: twi_trace_lost()
+ * Purpose:  Get and clear number of overwritten entries.
+ * Returns:  Number of lost entries
+ **********************************************************************/
+uint8_t twi_trace_lost(void)
+{
+    uint8_t lost;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        lost = twi_trace_overrun;
+        twi_trace_overrun = 0;
+    }
+    return lost;
+}
+#endif
+
+/**********************************************************************
+ * Function: twi_dev()
+ * Purpose:  Get registry entry of slave device.
+ * Input:    index Index of entry
+ * Returns:  Pointer to entry, NULL if the entry is unused
+ **********************************************************************/
+const twi_dev_t *twi_dev(uint8_t index)
+{
+    if (index >= TWI_MAX_DEVICES || twi_devs[index].address == 0)
+    {
+        return NULL;
+    }
+    return &twi_devs[index];
+}
+
+/**********************************************************************
+ * Function: TWI interrupt
+ * Purpose:  Process next step of current transaction.
+ **********************************************************************/
+ISR(TWI_vect)
+{
+    twi_service();
 }
@@ -29,6 +29,14 @@
  * This library defines functions for the TWI (I2C) communication between
  * AVR and slave device(s). Functions use internal TWI module of AVR.
  *
+ * Transactions described by twi_trans_t are queued by twi_submit() and
+ * processed in the background by the TWI interrupt. Functions
+ * twi_start(), twi_write(), twi_read_ack(), twi_read_nack() and
+ * twi_stop() keep the original blocking byte-level access. They wait
+ * for the queue to drain and hold the bus until twi_stop() is called.
+ * In parallel, the TWI can serve a register map to other masters as
+ * slave, see twi_slave_init().
+ *
  * @note Based on Microchip Atmel ATmega16 and ATmega328P manuals.
  * @author Tomas Fryza, Dept. of Radio Electronics, Brno University 
  *         of Technology, Czechia
@@ -51,6 +59,22 @@
 #define TWI_BIT_RATE_REG ((F_CPU/F_SCL - 16) / 2) /**< @brief TWI bit rate register value */
 
 
+/**
+ * @name Definitions of timeouts
+ * Every wait for the TWI hardware has a budget derived from F_SCL. When
+ * the bus does not move within the budget, the bus is recovered by nine
+ * SCL pulses and STOP condition, and the operation ends with
+ * TWI_ERR_TIMEOUT.
+ */
+#define TWI_BYTE_CYCLES (9UL * F_CPU / F_SCL) /**< @brief CPU cycles to transfer one byte including ACK */
+#ifndef TWI_TIMEOUT_BYTES
+# define TWI_TIMEOUT_BYTES 4 /**< @brief Byte times without bus progress until timeout */
+#endif
+/** @brief Poll loop iterations until timeout, one iteration takes at least 8 CPU cycles */
+#define TWI_TIMEOUT_LOOPS (TWI_TIMEOUT_BYTES * TWI_BYTE_CYCLES / 8)
+#define TWI_HALF_PERIOD_US (500000UL / F_SCL) /**< @brief Half period of SCL in us for bus recovery */
+
+
 /**
  * @name Definition of ports and pins
  */
@@ -70,6 +94,126 @@
 #define PIN(_x) (*(&_x - 2))
 
 
+/**
+ * @name Definitions of transaction engine
+ */
+#ifndef TWI_QUEUE_SIZE
+# define TWI_QUEUE_SIZE 4 /**< @brief Number of queued transactions, must be power of 2 */
+#endif
+#if (TWI_QUEUE_SIZE & (TWI_QUEUE_SIZE - 1))
+# error "TWI_QUEUE_SIZE is not a power of 2"
+#endif
+#ifndef TWI_MAX_DEVICES
+# define TWI_MAX_DEVICES 8 /**< @brief Number of slave devices in device registry */
+#endif
+#ifndef TWI_PROBE_COUNT
+# define TWI_PROBE_COUNT 4 /**< @brief Successive ACKs required by twi_dev_probe() */
+#endif
+
+
+/**
+ * @name Definitions of I2C multiplexer
+ * Slaves behind TCA9548A multiplexers are reached by setting channel of
+ * transaction. Up to 8 multiplexers with addresses TWI_MUX_ADDRESS + 0..7
+ * are supported, only one channel is enabled at a time. The selection is
+ * cached and the multiplexer is rewritten only when the channel changes.
+ * After a failed multiplexer write, the multiplexer that may still be
+ * enabled is disabled or rewritten before the next channel is used.
+ * Slaves on the main bus must not share address with slaves behind
+ * multiplexers.
+ */
+#ifndef TWI_MUX_ADDRESS
+# define TWI_MUX_ADDRESS 0x70 /**< @brief Address of the first TCA9548A, A2..A0 = 0 */
+#endif
+#define TWI_DIRECT 0 /**< @brief Slave is on the main bus */
+/** @brief Channel ch (0..7) of multiplexer mux (0..7) */
+#define TWI_CHANNEL(mux, ch) (0x80 | ((mux) << 3) | (ch))
+
+
+/**
+ * @name Definitions of transaction tracer
+ * When TWI_TRACE is defined, every finished transaction is recorded to
+ * a ring buffer of TWI_TRACE_SIZE entries. The oldest entry is
+ * overwritten when the buffer is full. Without TWI_TRACE, the tracer
+ * generates no code and no data.
+ */
+#ifdef TWI_TRACE
+# ifndef TWI_TRACE_SIZE
+#  define TWI_TRACE_SIZE 16 /**< @brief Number of trace entries, must be power of 2 */
+# endif
+# if (TWI_TRACE_SIZE & (TWI_TRACE_SIZE - 1))
+#  error "TWI_TRACE_SIZE is not a power of 2"
+# endif
+# ifndef TWI_TRACE_CLOCK
+#  define TWI_TRACE_CLOCK TCNT1 /**< @brief Free running 16-bit counter for timestamps */
+# endif
+#endif
+
+/** @brief Status of TWI transaction */
+typedef enum {
+    TWI_OK = 0,         /**< @brief Transaction finished successfully */
+    TWI_PENDING,        /**< @brief Transaction is queued or on the bus */
+    TWI_ERR_ADDR_NACK,  /**< @brief Slave did not acknowledge its address */
+    TWI_ERR_DATA_NACK,  /**< @brief Slave did not acknowledge data byte */
+    TWI_ERR_ARB_LOST,   /**< @brief Arbitration lost */
+    TWI_ERR_BUS,        /**< @brief Illegal START or STOP condition */
+    TWI_ERR_TIMEOUT     /**< @brief Bus did not move within timeout, bus was recovered */
+} twi_status_t;
+
+#define TWI_FIRST_ADDRESS 0x08 /**< @brief Lowest address probed by twi_enumerate() */
+#define TWI_LAST_ADDRESS 0x77 /**< @brief Highest address probed by twi_enumerate() */
+#define TWI_DEV_PRESENT 0x01 /**< @brief Device flag: Slave acknowledged its address */
+#define TWI_DEV_MUX 0x02 /**< @brief Device flag: Slave has address of TCA9548A */
+
+/**
+ * @brief Entry of device registry: presence, speed profile and
+ *        statistics of one slave device on the main bus.
+ */
+typedef struct {
+    uint8_t address;        /**< @brief 7-bit slave address, 0 - Unused entry */
+    uint8_t flags;          /**< @brief TWI_DEV_PRESENT, TWI_DEV_MUX */
+    uint8_t errors;         /**< @brief Number of failed transactions, saturates at 255 */
+    uint16_t scl_khz;       /**< @brief SCL frequency in kHz, 0 - Default F_SCL */
+    uint8_t twbr;           /**< @brief TWI bit rate register value */
+    uint8_t twps;           /**< @brief TWI prescaler bits TWPS1:0 */
+} twi_dev_t;
+
+/**
+ * @brief Descriptor of one TWI transaction.
+ *
+ * Transaction writes optional register address reg and tx_len bytes
+ * from tx_buf to the slave and then, after repeated START, reads rx_len
+ * bytes to rx_buf. The last byte is acknowledged by NACK and the
+ * transaction is closed by STOP. Descriptor and both buffers must stay
+ * valid until status is different from TWI_PENDING. Slaves behind
+ * multiplexers share speed profile and statistics of their address.
+ */
+typedef struct twi_trans {
+    uint8_t address;        /**< @brief 7-bit slave address */
+    uint8_t channel;        /**< @brief Multiplexer channel, see TWI_CHANNEL(), or TWI_DIRECT */
+    uint8_t reg_len;        /**< @brief 1 - Send reg before tx_buf, 0 - No register address */
+    uint8_t reg;            /**< @brief Register address inside the slave */
+    const uint8_t *tx_buf;  /**< @brief Bytes to be written */
+    uint8_t tx_len;         /**< @brief Number of bytes to be written */
+    uint8_t *rx_buf;        /**< @brief Buffer for received bytes */
+    uint8_t rx_len;         /**< @brief Number of bytes to be read */
+    volatile uint8_t status;    /**< @brief Transaction status, see twi_status_t */
+    /** @brief Called from TWI interrupt when transaction finishes, can be NULL */
+    void (*callback)(struct twi_trans *trans);
+} twi_trans_t;
+
+#ifdef TWI_TRACE
+/** @brief Trace entry of one finished transaction */
+typedef struct {
+    uint16_t start;         /**< @brief TWI_TRACE_CLOCK when START was requested */
+    uint16_t end;           /**< @brief TWI_TRACE_CLOCK when transaction finished */
+    uint8_t address;        /**< @brief 7-bit slave address */
+    uint8_t len;            /**< @brief Number of register, written and read bytes */
+    uint8_t status;         /**< @brief Final status, see twi_status_t */
+} twi_trace_t;
+#endif
+
+
 /* Function prototypes -----------------------------------------------*/
 /**
  * @name Functions
@@ -91,7 +235,7 @@ void twi_init(void);
  * @brief  Start communication on TWI bus and send address of TWI slave.
  * @param  slave_address SLA+R or SLA+W address
  * @retval 0 - Slave device accessible
- * @retval 1 - Failed to access slave device
+ * @retval >0 - Failed to access slave device, see twi_status_t
  * @note   Function returns 0 only if 0x18 or 0x40 status code is detected\n
  *           0x18: SLA+W has been transmitted and ACK has been received\n
  *           0x40: SLA+R has been transmitted and ACK has been received\n
@@ -102,21 +246,22 @@ uint8_t twi_start(uint8_t slave_address);
 /**
  * @brief  Send one data byte to TWI slave device.
  * @param  data Byte to be transmitted
- * @return none
+ * @retval 0 - Byte transmitted
+ * @retval >0 - Failed, see twi_status_t
  */
-void twi_write(uint8_t data);
+uint8_t twi_write(uint8_t data);
 
 
 /**
  * @brief  Read one byte from TWI slave device and acknowledge it by ACK.
- * @return Received data byte
+ * @return Received data byte, 0xff after timeout
  */
 uint8_t twi_read_ack(void);
 
 
 /**
  * @brief  Read one byte from TWI slave device and acknowledge it by NACK.
- * @return Received data byte
+ * @return Received data byte, 0xff after timeout
  */
 uint8_t twi_read_nack(void);
 
@@ -127,6 +272,224 @@ uint8_t twi_read_nack(void);
  */
 void twi_stop(void);
 
+
+/**
+ * @brief  Queue a transaction and return immediately.
+ * @param  trans Transaction descriptor
+ * @retval 0 - Transaction queued, trans->status is TWI_PENDING
+ * @retval 1 - Queue is full, transaction not accepted
+ * @note   Transaction is processed in TWI interrupt. Function can be
+ *         called from interrupt service routines and callbacks.
+ */
+uint8_t twi_submit(twi_trans_t *trans);
+
+
+/**
+ * @brief  Wait until transaction finishes.
+ * @param  trans Transaction descriptor passed to twi_submit()
+ * @return Final status of transaction, see twi_status_t
+ * @note   If global interrupts are disabled, the engine is serviced
+ *         by polling, so the function can be used before sei() or
+ *         inside an interrupt service routine.
+ */
+uint8_t twi_wait(twi_trans_t *trans);
+
+
+/**
+ * @brief  Blocking write/read transaction, thin wrapper over twi_submit().
+ * @param  address 7-bit slave address
+ * @param  tx_buf  Bytes to be written
+ * @param  tx_len  Number of bytes to be written
+ * @param  rx_buf  Buffer for received bytes
+ * @param  rx_len  Number of bytes to be read
+ * @return Final status of transaction, see twi_status_t
+ */
+uint8_t twi_transfer(uint8_t address, const uint8_t *tx_buf, uint8_t tx_len,
+                     uint8_t *rx_buf, uint8_t rx_len);
+
+
+/**
+ * @brief  Burst read of consecutive slave registers.
+ *
+ * Register address is written, followed by repeated START, len bytes
+ * are read, the last one is acknowledged by NACK and STOP is generated.
+ * @param  address 7-bit slave address
+ * @param  reg     Address of the first register
+ * @param  buf     Buffer for received bytes
+ * @param  len     Number of registers to be read
+ * @return Final status of transaction, see twi_status_t
+ */
+uint8_t twi_read_regs(uint8_t address, uint8_t reg, uint8_t *buf, uint8_t len);
+
+
+/**
+ * @brief  Burst write of consecutive slave registers.
+ * @param  address 7-bit slave address
+ * @param  reg     Address of the first register
+ * @param  buf     Bytes to be written
+ * @param  len     Number of registers to be written
+ * @return Final status of transaction, see twi_status_t
+ */
+uint8_t twi_write_regs(uint8_t address, uint8_t reg, const uint8_t *buf, uint8_t len);
+
+
+/**
+ * @brief  Test whether the transaction engine is idle.
+ * @retval 1 - No transaction is queued or on the bus
+ * @retval 0 - Engine is busy
+ */
+uint8_t twi_idle(void);
+
+
+/**
+ * @brief  Watchdog of the transaction engine.
+ *
+ * Transaction which has not moved since the previous call is aborted
+ * with TWI_ERR_TIMEOUT and the bus is recovered.
+ * @return none
+ * @note   Call periodically, e.g. from timer interrupt. The period sets
+ *         the worst-case time of a stuck transaction.
+ */
+void twi_tick(void);
+
+
+/**
+ * @brief  Release stuck slave and reinitialize TWI module.
+ *
+ * SCL is clocked up to nine times until the slave releases SDA, then
+ * STOP condition is generated and TWI bit rate is set again.
+ * @return none
+ */
+void twi_recover(void);
+
+
+/**
+ * @brief  Set SCL frequency used for slave device.
+ *
+ * TWI bit rate and prescaler are reprogrammed before each transaction
+ * with the slave. Slaves which are not in device table use F_SCL.
+ * @param  address 7-bit slave address
+ * @param  scl_khz SCL frequency in kHz, 0 - Default F_SCL
+ * @retval 0 - Frequency set
+ * @retval 1 - Device table is full
+ */
+uint8_t twi_dev_set_speed(uint8_t address, uint16_t scl_khz);
+
+
+/**
+ * @brief  Find the highest SCL frequency the slave reliably works at.
+ *
+ * Frequencies 400 kHz, 100 kHz and F_SCL not greater than max_khz are
+ * tried in this order. The first one at which the slave acknowledges
+ * its address TWI_PROBE_COUNT times in a row is used for the slave.
+ * @param  address 7-bit slave address
+ * @param  max_khz Maximal SCL frequency of the slave in kHz
+ * @return Selected SCL frequency in kHz, 0 - Slave not found
+ * @note   Blocking function intended for initialization.
+ */
+uint16_t twi_dev_probe(uint8_t address, uint16_t max_khz);
+
+
+/**
+ * @brief  Test whether the slave acknowledges its address.
+ * @param  address 7-bit slave address
+ * @param  channel Multiplexer channel, see TWI_CHANNEL(), or TWI_DIRECT
+ * @return Transaction status, see twi_status_t
+ * @note   Blocking function. Errors are not counted in statistics.
+ */
+uint8_t twi_probe(uint8_t address, uint8_t channel);
+
+
+/**
+ * @brief  Probe all addresses of the main bus and build device registry.
+ *
+ * Every slave which acknowledges its address is added to the registry
+ * with flag TWI_DEV_PRESENT, the flag of registered slaves which do not
+ * respond is cleared. After enumeration, the flag is kept up to date by
+ * transactions on the main bus: set by success, cleared by address NACK.
+ * @return Number of slaves found
+ * @note   Blocking function intended for initialization.
+ */
+uint8_t twi_enumerate(void);
+
+
+/**
+ * @brief  Test whether registered slave is present.
+ * @param  address 7-bit slave address
+ * @retval 1 - Slave is in registry and acknowledged its last access
+ * @retval 0 - Slave is absent or not registered
+ */
+uint8_t twi_dev_present(uint8_t address);
+
+
+/**
+ * @brief  Queue probe of the next absent slave in registry. Slaves which
+ *         come back are marked present again.
+ * @return none
+ * @note   Call at a low rate, for example once per scan cycle.
+ */
+void twi_rescan(void);
+
+
+/**
+ * @brief  Get registry entry of slave device.
+ * @param  index Index of entry in the interval 0 to TWI_MAX_DEVICES-1
+ * @return Pointer to entry, NULL if the entry is unused
+ */
+const twi_dev_t *twi_dev(uint8_t index);
+
+
+/**
+ * @brief  Respond to masters as slave with read-only register map.
+ *
+ * The first byte written by a master sets the register pointer, other
+ * written bytes are ignored. Reading returns registers from the pointer
+ * on, 0xff beyond the end of the map, and the pointer auto-increments.
+ * The map is double buffered: the application fills the buffer returned
+ * by twi_slave_back() and publishes it by twi_slave_publish(). A read
+ * always comes from one buffer, so a master never gets a half-updated
+ * map. When master transaction loses arbitration to access of this
+ * slave, it is started again after the access.
+ * @param  address Own 7-bit slave address
+ * @param  buf0 First buffer of register map
+ * @param  buf1 Second buffer of register map
+ * @param  len Size of register map in bytes
+ * @return none
+ */
+void twi_slave_init(uint8_t address, uint8_t *buf0, uint8_t *buf1, uint8_t len);
+
+
+/**
+ * @brief  Get buffer of register map to be filled by the application.
+ * @return Pointer to buffer, NULL if a master is still reading it
+ */
+uint8_t *twi_slave_back(void);
+
+
+/**
+ * @brief  Publish buffer returned by twi_slave_back() to masters.
+ * @return none
+ */
+void twi_slave_publish(void);
+
+#ifdef TWI_TRACE
+
+/**
+ * @brief  Remove the oldest entry from trace buffer.
+ * @param  entry Copy of the entry
+ * @retval 1 - Entry copied
+ * @retval 0 - Trace buffer is empty
+ */
+uint8_t twi_trace_read(twi_trace_t *entry);
+
+
+/**
+ * @brief  Get and clear number of entries overwritten since last call.
+ * @return Number of lost entries, saturates at 255
+ */
+uint8_t twi_trace_lost(void);
+#endif
+
 /** @} */
 
 #endif
@@ -13,7 +13,8 @@
 *
 *   The UART_RX_BUFFER_SIZE and UART_TX_BUFFER_SIZE variables define
 *   the buffer size in bytes. Note that these variables must be a
-*   power of 2.
+*   power of 2. Buffers larger than 256 bytes use 16 bit indices, which
+*   the main program accesses with interrupts disabled.
 *
 *  USAGE:
 *   Refere to the header file uart.h for a description of the routines.
@@ -39,6 +40,7 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <string.h>
 #include "uart.h"
 
 
@@ -57,6 +59,25 @@
 # error TX buffer size is not a power of 2
 #endif
 
+/* index width, 8 bit for buffers up to 256 bytes */
+#if ( UART_RX_BUFFER_SIZE > 256 )
+typedef unsigned int  uart_rx_idx_t;
+#else
+typedef unsigned char uart_rx_idx_t;
+#endif
+#if ( UART_TX_BUFFER_SIZE > 256 )
+typedef unsigned int  uart_tx_idx_t;
+#else
+typedef unsigned char uart_tx_idx_t;
+#endif
+
+/* bytes copied with interrupts disabled at once */
+#define UART_TX_CHUNK 32
+
+#if ( UART_TX_OVERFLOW_POLICY < UART_TX_BLOCK ) || ( UART_TX_OVERFLOW_POLICY > UART_TX_TRUNCATE )
+# error UART_TX_OVERFLOW_POLICY is not valid
+#endif
+
 
 #if defined(__AVR_AT90S2313__) || defined(__AVR_AT90S4414__) || defined(__AVR_AT90S8515__) || \
     defined(__AVR_AT90S4434__) || defined(__AVR_AT90S8535__) || \
@@ -334,29 +355,107 @@
 # error "no UART definition for MCU available"
 #endif /* if defined(__AVR_AT90S2313__) || defined(__AVR_AT90S4414__) || defined(__AVR_AT90S8515__) || defined(__AVR_AT90S4434__) || defined(__AVR_AT90S8535__) || defined(__AVR_ATmega103__) */
 
+/* transmit complete flag, used by uart_set_baudrate() */
+#if defined(TXC0)
+# define UART0_BIT_TXC            TXC0
+#elif defined(TXC)
+# define UART0_BIT_TXC            TXC
+#endif
+
 
 /*
  *  module global variables
  */
 static volatile unsigned char UART_TxBuf[UART_TX_BUFFER_SIZE];
 static volatile unsigned char UART_RxBuf[UART_RX_BUFFER_SIZE];
-static volatile unsigned char UART_TxHead;
-static volatile unsigned char UART_TxTail;
-static volatile unsigned char UART_RxHead;
-static volatile unsigned char UART_RxTail;
+static volatile uart_tx_idx_t UART_TxHead;
+static volatile uart_tx_idx_t UART_TxTail;
+static volatile uart_rx_idx_t UART_RxHead;
+static volatile uart_rx_idx_t UART_RxTail;
 static volatile unsigned char UART_LastRxError;
+static volatile unsigned int  UART_TxOverflows;
+#if UART_TX_OVERFLOW_POLICY == UART_TX_TRUNCATE
+static volatile unsigned char UART_TxTruncated;
+#endif
 
 #if defined( ATMEGA_USART1 )
 static volatile unsigned char UART1_TxBuf[UART_TX_BUFFER_SIZE];
 static volatile unsigned char UART1_RxBuf[UART_RX_BUFFER_SIZE];
-static volatile unsigned char UART1_TxHead;
-static volatile unsigned char UART1_TxTail;
-static volatile unsigned char UART1_RxHead;
-static volatile unsigned char UART1_RxTail;
+static volatile uart_tx_idx_t UART1_TxHead;
+static volatile uart_tx_idx_t UART1_TxTail;
+static volatile uart_rx_idx_t UART1_RxHead;
+static volatile uart_rx_idx_t UART1_RxTail;
 static volatile unsigned char UART1_LastRxError;
 #endif
 
 
+/*************************************************************************
+ * Function: uart_rx_load(), uart_rx_store()
+ * Purpose:  access receive index shared with interrupt routine,
+ *           16 bit indices with interrupts disabled
+ **************************************************************************/
+static inline uart_rx_idx_t uart_rx_load(volatile uart_rx_idx_t *idx)
+{
+    #if UART_RX_BUFFER_SIZE > 256
+    uart_rx_idx_t val;
+    unsigned char sreg = SREG;
+
+    cli();
+    val  = *idx;
+    SREG = sreg;
+    return val;
+    #else
+    return *idx;
+    #endif
+}/* uart_rx_load */
+
+static inline void uart_rx_store(volatile uart_rx_idx_t *idx, uart_rx_idx_t val)
+{
+    #if UART_RX_BUFFER_SIZE > 256
+    unsigned char sreg = SREG;
+
+    cli();
+    *idx = val;
+    SREG = sreg;
+    #else
+    *idx = val;
+    #endif
+}/* uart_rx_store */
+
+/*************************************************************************
+ * Function: uart_tx_load(), uart_tx_store()
+ * Purpose:  access transmit index shared with interrupt routine,
+ *           16 bit indices with interrupts disabled
+ **************************************************************************/
+static inline uart_tx_idx_t uart_tx_load(volatile uart_tx_idx_t *idx)
+{
+    #if UART_TX_BUFFER_SIZE > 256
+    uart_tx_idx_t val;
+    unsigned char sreg = SREG;
+
+    cli();
+    val  = *idx;
+    SREG = sreg;
+    return val;
+    #else
+    return *idx;
+    #endif
+}/* uart_tx_load */
+
+static inline void uart_tx_store(volatile uart_tx_idx_t *idx, uart_tx_idx_t val)
+{
+    #if UART_TX_BUFFER_SIZE > 256
+    unsigned char sreg = SREG;
+
+    cli();
+    *idx = val;
+    SREG = sreg;
+    #else
+    *idx = val;
+    #endif
+}/* uart_tx_store */
+
+
 ISR(UART0_RECEIVE_INTERRUPT)
 
 /*************************************************************************
@@ -364,7 +463,7 @@ ISR(UART0_RECEIVE_INTERRUPT)
  * Purpose:  called when the UART has received a character
  **************************************************************************/
 {
-    unsigned char tmphead;
+    uart_rx_idx_t tmphead;
     unsigned char data;
     unsigned char usr;
     unsigned char lastRxError = 0;
@@ -411,7 +510,7 @@ ISR(UART0_TRANSMIT_INTERRUPT)
  * Purpose:  called when the UART is ready to transmit the next byte
  **************************************************************************/
 {
-    unsigned char tmptail;
+    uart_tx_idx_t tmptail;
 
 
     if (UART_TxHead != UART_TxTail)
@@ -426,10 +525,39 @@ ISR(UART0_TRANSMIT_INTERRUPT)
     {
         /* tx buffer empty, disable UDRE interrupt */
         UART0_CONTROL &= ~_BV(UART0_UDRIE);
+        #ifdef UART0_BIT_TXC
+        /* last byte has just entered the shift register, TXC is set when it is out */
+        UART0_STATUS |= _BV(UART0_BIT_TXC);
+        #endif
     }
 }
 
 
+/*************************************************************************
+ * Function: uart_baud()
+ * Purpose:  set baudrate registers, select or deselect double speed
+ * Input:    baudrate using macro UART_BAUD_SELECT_AUTO()
+ * Returns:  none
+ **************************************************************************/
+static void uart_baud(unsigned int baudrate)
+{
+    #if UART0_BIT_U2X
+    if (baudrate & 0x8000)
+    {
+        UART0_STATUS |= _BV(UART0_BIT_U2X);  // Enable 2x speed
+    }
+    else
+    {
+        UART0_STATUS &= ~_BV(UART0_BIT_U2X);
+    }
+    #endif
+    #if defined(UART0_UBRRH)
+    UART0_UBRRH = (unsigned char) ((baudrate >> 8) & 0x0F);
+    #endif
+    UART0_UBRRL = (unsigned char) (baudrate & 0x00FF);
+}/* uart_baud */
+
+
 /*************************************************************************
  * Function: uart_init()
  * Purpose:  initialize UART and set baudrate
@@ -442,6 +570,7 @@ void uart_init(unsigned int baudrate)
     UART_TxTail = 0;
     UART_RxHead = 0;
     UART_RxTail = 0;
+    UART_TxOverflows = 0;
 
     #ifdef UART_TEST
     # ifndef UART0_BIT_U2X
@@ -461,16 +590,7 @@ void uart_init(unsigned int baudrate)
     #endif /* ifdef UART_TEST */
 
     /* Set baud rate */
-    if (baudrate & 0x8000)
-    {
-        #if UART0_BIT_U2X
-        UART0_STATUS = (1 << UART0_BIT_U2X); // Enable 2x speed
-        #endif
-    }
-    #if defined(UART0_UBRRH)
-    UART0_UBRRH = (unsigned char) ((baudrate >> 8) & 0x80);
-    #endif
-    UART0_UBRRL = (unsigned char) (baudrate & 0x00FF);
+    uart_baud(baudrate);
 
     /* Enable USART receiver and transmitter and receive complete interrupt */
     UART0_CONTROL = _BV(UART0_BIT_RXCIE) | (1 << UART0_BIT_RXEN) | (1 << UART0_BIT_TXEN);
@@ -485,6 +605,33 @@ void uart_init(unsigned int baudrate)
     #endif
 }/* uart_init */
 
+
+/*************************************************************************
+ * Function: uart_set_baudrate()
+ * Purpose:  change baudrate after all buffered data has been sent
+ * Input:    baudrate using macro UART_BAUD_SELECT_AUTO()
+ * Returns:  none
+ **************************************************************************/
+void uart_set_baudrate(unsigned int baudrate)
+{
+    unsigned int timeout = 0xFFFF;
+
+
+    /* UDRE interrupt is disabled once the ringbuffer is empty */
+    while (UART0_CONTROL & _BV(UART0_UDRIE))
+    {
+        ;
+    }
+    #ifdef UART0_BIT_TXC
+    /* wait for the last byte to leave the shift register, at most one frame */
+    while (!(UART0_STATUS & _BV(UART0_BIT_TXC)) && --timeout)
+    {
+        ;
+    }
+    #endif
+    uart_baud(baudrate);
+}/* uart_set_baudrate */
+
 /*************************************************************************
  * Function: uart_getc()
  * Purpose:  return byte from ringbuffer
@@ -493,12 +640,12 @@ void uart_init(unsigned int baudrate)
  **************************************************************************/
 unsigned int uart_getc(void)
 {
-    unsigned char tmptail;
+    uart_rx_idx_t tmptail;
     unsigned char data;
     unsigned char lastRxError;
 
 
-    if (UART_RxHead == UART_RxTail)
+    if (uart_rx_load(&UART_RxHead) == UART_RxTail)
     {
         return UART_NO_DATA; /* no data available */
     }
@@ -511,28 +658,89 @@ unsigned int uart_getc(void)
     lastRxError = UART_LastRxError;
 
     /* store buffer index */
-    UART_RxTail = tmptail;
+    uart_rx_store(&UART_RxTail, tmptail);
 
     UART_LastRxError = 0;
     return (lastRxError << 8) + data;
 }/* uart_getc */
 
 /*************************************************************************
- * Function: uart_putc()
- * Purpose:  write byte to ringbuffer for transmitting via UART
+ * Function: uart_tx_mark()
+ * Purpose:  store pending truncation marker if there is space
+ * Input:    index of last stored byte
+ * Returns:  index of last stored byte including the marker
+ **************************************************************************/
+static uart_tx_idx_t uart_tx_mark(uart_tx_idx_t head)
+{
+    #if UART_TX_OVERFLOW_POLICY == UART_TX_TRUNCATE
+    uart_tx_idx_t tmphead = (head + 1) & UART_TX_BUFFER_MASK;
+
+    if (UART_TxTruncated && tmphead != uart_tx_load(&UART_TxTail))
+    {
+        UART_TxBuf[tmphead] = UART_TX_MARKER;
+        UART_TxTruncated    = 0;
+        head                = tmphead;
+    }
+    #endif
+    return head;
+}/* uart_tx_mark */
+
+/*************************************************************************
+ * Function: uart_tx_put()
+ * Purpose:  write byte to ringbuffer, apply overflow policy when full
  * Input:    byte to be transmitted
- * Returns:  none
+ *           wait for free space if interrupts are enabled
+ * Returns:  1 if the byte was stored, 0 if it was discarded
  **************************************************************************/
-void uart_putc(unsigned char data)
+static unsigned char uart_tx_put(unsigned char data, unsigned char wait)
 {
-    unsigned char tmphead;
+    uart_tx_idx_t tmphead;
+    unsigned char sreg = SREG;
+
+
+    /* interrupt routines may write too, so the head is updated with interrupts disabled */
+    cli();
 
+    /* mark the gap before the first byte stored after it */
+    UART_TxHead = uart_tx_mark(UART_TxHead);
 
     tmphead = (UART_TxHead + 1) & UART_TX_BUFFER_MASK;
 
     while (tmphead == UART_TxTail)
     {
-        ;/* wait for free space in buffer */
+        #if UART_TX_OVERFLOW_POLICY == UART_TX_BLOCK
+        if (wait)
+        #else
+        if (wait && (sreg & _BV(SREG_I)))
+        #endif
+        {
+            /* wait for free space in buffer, then check the head again */
+            SREG = sreg;
+            while (tmphead == uart_tx_load(&UART_TxTail))
+            {
+                ;
+            }
+            cli();
+            UART_TxHead = uart_tx_mark(UART_TxHead);
+            tmphead     = (UART_TxHead + 1) & UART_TX_BUFFER_MASK;
+        }
+        else
+        {
+            if (UART_TxOverflows != 0xFFFF)
+            {
+                UART_TxOverflows++;
+            }
+            #if UART_TX_OVERFLOW_POLICY == UART_TX_DROP_OLDEST
+            UART_TxTail = (UART_TxTail + 1) & UART_TX_BUFFER_MASK;
+            #else
+            # if UART_TX_OVERFLOW_POLICY == UART_TX_TRUNCATE
+            UART_TxTruncated = 1;
+            # endif
+            UART0_CONTROL |= _BV(UART0_UDRIE);
+            SREG = sreg;
+            return 0;
+            #endif
+        }
     }
 
     UART_TxBuf[tmphead] = data;
@@ -540,34 +748,209 @@ void uart_putc(unsigned char data)
 
     /* enable UDRE interrupt */
     UART0_CONTROL |= _BV(UART0_UDRIE);
+    SREG = sreg;
+    return 1;
+}/* uart_tx_put */
+
+/*************************************************************************
+ * Function: uart_tx_copy()
+ * Purpose:  copy as many bytes as fit into ringbuffer, in at most two
+ *           contiguous runs, and publish the new head index once;
+ *           at most UART_TX_CHUNK bytes to keep interrupt latency short
+ * Input:    bytes to be transmitted and their number
+ * Returns:  number of bytes copied
+ **************************************************************************/
+static unsigned int uart_tx_copy(const unsigned char *buf, unsigned int len)
+{
+    uart_tx_idx_t head;
+    uart_tx_idx_t start;
+    uart_tx_idx_t space;
+    unsigned int  first;
+    unsigned char sreg = SREG;
+
+
+    /* interrupt routines may write too, keep them off while copying */
+    if (len > UART_TX_CHUNK)
+    {
+        len = UART_TX_CHUNK;
+    }
+    cli();
+    head  = uart_tx_mark(UART_TxHead);
+    space = (UART_TxTail - head - 1) & UART_TX_BUFFER_MASK;
+    if (len > space)
+    {
+        len = space;
+    }
+
+    start = (head + 1) & UART_TX_BUFFER_MASK;
+    first = UART_TX_BUFFER_SIZE - start;
+    if (len <= first)
+    {
+        memcpy((unsigned char *)&UART_TxBuf[start], buf, len);
+    }
+    else
+    {
+        memcpy((unsigned char *)&UART_TxBuf[start], buf, first);
+        memcpy((unsigned char *)&UART_TxBuf[0], buf + first, len - first);
+    }
+    UART_TxHead = (head + len) & UART_TX_BUFFER_MASK;
+
+    /* enable UDRE interrupt */
+    UART0_CONTROL |= _BV(UART0_UDRIE);
+    SREG = sreg;
+    return len;
+}/* uart_tx_copy */
+
+/*************************************************************************
+ * Function: uart_tx_write()
+ * Purpose:  write bytes to ringbuffer, apply overflow policy when full
+ * Input:    bytes to be transmitted and their number
+ *           wait for free space if interrupts are enabled
+ * Returns:  number of bytes stored
+ **************************************************************************/
+static unsigned int uart_tx_write(const unsigned char *buf, unsigned int len, unsigned char wait)
+{
+    unsigned int stored = 0;
+    unsigned int n;
+
+
+    while (len)
+    {
+        n       = uart_tx_copy(buf, len);
+        stored += n;
+        buf    += n;
+        len    -= n;
+        if (len && n == 0)
+        {
+            /* buffer is full, wait or discard by single byte path */
+            stored += uart_tx_put(*buf++, wait);
+            len--;
+        }
+    }
+    return stored;
+}/* uart_tx_write */
+
+/*************************************************************************
+ * Function: uart_putc()
+ * Purpose:  write byte to ringbuffer for transmitting via UART
+ * Input:    byte to be transmitted
+ * Returns:  1 if the byte was stored, 0 if it was discarded
+ **************************************************************************/
+unsigned char uart_putc(unsigned char data)
+{
+    return uart_tx_put(data, 1);
 }/* uart_putc */
 
 /*************************************************************************
  * Function: uart_puts()
  * Purpose:  transmit string to UART
  * Input:    string to be transmitted
- * Returns:  none
+ * Returns:  number of characters stored
  **************************************************************************/
-void uart_puts(const char *s)
+unsigned int uart_puts(const char *s)
 {
-    while (*s)
-        uart_putc(*s++);
+    return uart_tx_write((const unsigned char *)s, strlen(s), 1);
 }/* uart_puts */
 
+/*************************************************************************
+ * Function: uart_puts_nb()
+ * Purpose:  transmit string to UART without waiting for free space
+ * Input:    string to be transmitted
+ * Returns:  number of characters stored
+ **************************************************************************/
+unsigned int uart_puts_nb(const char *s)
+{
+    return uart_tx_write((const unsigned char *)s, strlen(s), 0);
+}/* uart_puts_nb */
+
+/*************************************************************************
+ * Function: uart_write()
+ * Purpose:  transmit block of bytes to UART
+ * Input:    bytes to be transmitted and their number
+ * Returns:  number of bytes stored
+ **************************************************************************/
+unsigned int uart_write(const unsigned char *buf, unsigned int len)
+{
+    return uart_tx_write(buf, len, 1);
+}/* uart_write */
+
+/*************************************************************************
+ * Function: uart_tx_reserve()
+ * Purpose:  reserve free space in ringbuffer for direct writing
+ * Input:    span to be filled, requested number of bytes
+ * Returns:  number of bytes reserved
+ **************************************************************************/
+unsigned int uart_tx_reserve(uart_span_t *span, unsigned int len)
+{
+    uart_tx_idx_t head;
+    uart_tx_idx_t start;
+    uart_tx_idx_t space;
+    unsigned int  first;
+
+
+    head = uart_tx_mark(UART_TxHead);
+    uart_tx_store(&UART_TxHead, head);
+    space = (uart_tx_load(&UART_TxTail) - head - 1) & UART_TX_BUFFER_MASK;
+    if (len > space)
+    {
+        len = space;
+    }
+
+    start    = (head + 1) & UART_TX_BUFFER_MASK;
+    first    = UART_TX_BUFFER_SIZE - start;
+    span->p1 = (unsigned char *)&UART_TxBuf[start];
+    span->n1 = (len < first) ? len : first;
+    span->p2 = (unsigned char *)&UART_TxBuf[0];
+    span->n2 = len - span->n1;
+    return len;
+}/* uart_tx_reserve */
+
+/*************************************************************************
+ * Function: uart_tx_commit()
+ * Purpose:  publish bytes written into reserved space
+ * Input:    number of bytes written, at most the reserved number
+ * Returns:  none
+ **************************************************************************/
+void uart_tx_commit(unsigned int len)
+{
+    uart_tx_store(&UART_TxHead, (UART_TxHead + len) & UART_TX_BUFFER_MASK);
+
+    /* enable UDRE interrupt */
+    UART0_CONTROL |= _BV(UART0_UDRIE);
+}/* uart_tx_commit */
+
 /*************************************************************************
  * Function: uart_puts_p()
  * Purpose:  transmit string from program memory to UART
  * Input:    program memory string to be transmitted
- * Returns:  none
+ * Returns:  number of characters stored
  **************************************************************************/
-void uart_puts_p(const char *progmem_s)
+unsigned int uart_puts_p(const char *progmem_s)
 {
     register char c;
+    unsigned int n = 0;
 
     while ( (c = pgm_read_byte(progmem_s++)) )
-        uart_putc(c);
+        n += uart_tx_put(c, 1);
+    return n;
 }/* uart_puts_p */
 
+/*************************************************************************
+ * Function: uart_tx_overflows()
+ * Purpose:  return number of bytes discarded because of full buffer
+ * Returns:  number of discarded bytes
+ **************************************************************************/
+unsigned int uart_tx_overflows(void)
+{
+    unsigned int n;
+    unsigned char sreg = SREG;
+
+    cli();
+    n = UART_TxOverflows;
+    SREG = sreg;
+    return n;
+}/* uart_tx_overflows */
+
 /*
  * these functions are only for ATmegas with two USART
  */
@@ -580,7 +963,7 @@ ISR(UART1_RECEIVE_INTERRUPT)
  * Purpose:  called when the UART1 has received a character
  **************************************************************************/
 {
-    unsigned char tmphead;
+    uart_rx_idx_t tmphead;
     unsigned char data;
     unsigned char usr;
     unsigned char lastRxError;
@@ -619,7 +1002,7 @@ ISR(UART1_TRANSMIT_INTERRUPT)
  * Purpose:  called when the UART1 is ready to transmit the next byte
  **************************************************************************/
 {
-    unsigned char tmptail;
+    uart_tx_idx_t tmptail;
 
 
     if (UART1_TxHead != UART1_TxTail)
@@ -697,12 +1080,12 @@ void uart1_init(unsigned int baudrate)
  **************************************************************************/
 unsigned int uart1_getc(void)
 {
-    unsigned char tmptail;
+    uart_rx_idx_t tmptail;
     unsigned int data;
     unsigned char lastRxError;
 
 
-    if (UART1_RxHead == UART1_RxTail)
+    if (uart_rx_load(&UART1_RxHead) == UART1_RxTail)
     {
         return UART_NO_DATA; /* no data available */
     }
@@ -715,7 +1098,7 @@ unsigned int uart1_getc(void)
     lastRxError = UART1_LastRxError;
 
     /* store buffer index */
-    UART1_RxTail = tmptail;
+    uart_rx_store(&UART1_RxTail, tmptail);
 
     UART1_LastRxError = 0;
     return (lastRxError << 8) + data;
@@ -729,18 +1112,18 @@ unsigned int uart1_getc(void)
  **************************************************************************/
 void uart1_putc(unsigned char data)
 {
-    unsigned char tmphead;
+    uart_tx_idx_t tmphead;
 
 
     tmphead = (UART1_TxHead + 1) & UART_TX_BUFFER_MASK;
 
-    while (tmphead == UART1_TxTail)
+    while (tmphead == uart_tx_load(&UART1_TxTail))
     {
         ;/* wait for free space in buffer */
     }
 
     UART1_TxBuf[tmphead] = data;
-    UART1_TxHead         = tmphead;
+    uart_tx_store(&UART1_TxHead, tmphead);
 
     /* enable UDRE interrupt */
     UART1_CONTROL |= _BV(UART1_UDRIE);
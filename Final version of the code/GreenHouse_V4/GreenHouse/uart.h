@@ -75,10 +75,68 @@
  */
 #define UART_BAUD_SELECT_DOUBLE_SPEED(baudRate, xtalCpu) ( ((((xtalCpu) + 4UL * (baudRate)) / (8UL * (baudRate)) - 1UL)) | 0x8000)
 
+/** @brief  Baudrate actually generated with clock divider 16 (normal) or 8 (double speed) */
+#define UART_BAUD_ACTUAL(baudRate, xtalCpu, div) \
+    ((xtalCpu) / ((div) * (((xtalCpu) + (div) / 2 * (baudRate)) / ((div) * (baudRate)))))
+
+/** @brief  Baudrate error in permille with clock divider 16 or 8 */
+#define UART_BAUD_ERROR(baudRate, xtalCpu, div) \
+    ((UART_BAUD_ACTUAL(baudRate, xtalCpu, div) > (baudRate) ? \
+      UART_BAUD_ACTUAL(baudRate, xtalCpu, div) - (baudRate) : \
+      (baudRate) - UART_BAUD_ACTUAL(baudRate, xtalCpu, div)) * 1000UL / (baudRate))
+
+/** @brief  UART Baudrate Expression choosing the mode with smaller error
+ *
+ *  Normal mode samples each bit more often, so it is preferred when both
+ *  modes give the same error. Usable wherever UART_BAUD_SELECT() is.
+ *  @param  xtalCpu  system clock in Mhz, e.g. 16000000UL for 16Mhz
+ *  @param  baudRate baudrate in bps, e.g. 9600, 115200, 1000000
+ */
+#define UART_BAUD_SELECT_AUTO(baudRate, xtalCpu) \
+    (UART_BAUD_ERROR(baudRate, xtalCpu, 16UL) <= UART_BAUD_ERROR(baudRate, xtalCpu, 8UL) ? \
+     UART_BAUD_SELECT(baudRate, xtalCpu) : UART_BAUD_SELECT_DOUBLE_SPEED(baudRate, xtalCpu))
+
+/** @brief  Baudrate error in permille of UART_BAUD_SELECT_AUTO() */
+#define UART_BAUD_ERROR_AUTO(baudRate, xtalCpu) \
+    (UART_BAUD_ERROR(baudRate, xtalCpu, 16UL) <= UART_BAUD_ERROR(baudRate, xtalCpu, 8UL) ? \
+     UART_BAUD_ERROR(baudRate, xtalCpu, 16UL) : UART_BAUD_ERROR(baudRate, xtalCpu, 8UL))
+
+/** @brief  Baudrate used after reset, see UART_BAUD_CHECK() */
+#ifndef UART_BAUD
+# define UART_BAUD 9600UL
+#endif
+
+/** @brief  Largest accepted baudrate error in permille
+ *
+ *  Both ends may deviate, so each should stay well below the 4-5 % the
+ *  receiver tolerates. 115200 Bd from 16 MHz is 21 permille off in double
+ *  speed mode, 250000, 500000 and 1000000 Bd are exact.
+ */
+#ifndef UART_BAUD_MAX_ERROR
+# define UART_BAUD_MAX_ERROR 25
+#endif
+
+/** @brief  Stop compilation if a baudrate cannot be generated precisely enough
+ *
+ *  Use at file scope, once for every baudrate passed to
+ *  UART_BAUD_SELECT_AUTO(). Fails with "size of array is negative".
+ */
+#define UART_BAUD_CHECK(baudRate, xtalCpu) \
+    extern char uart_baud_check[(UART_BAUD_ERROR_AUTO(baudRate, xtalCpu) <= UART_BAUD_MAX_ERROR && \
+                                 UART_BAUD_SELECT(baudRate, xtalCpu) < 4096UL) ? 1 : -1]
+
+#if defined(F_CPU)
+# if UART_BAUD_ERROR_AUTO(UART_BAUD, F_CPU) > UART_BAUD_MAX_ERROR
+#  error "UART_BAUD cannot be generated from F_CPU within UART_BAUD_MAX_ERROR"
+# endif
+#endif
+
 /** @brief  Size of the circular receive buffer, must be power of 2
  *
  *  You may need to adapt this constant to your target and your application by adding
  *  CDEFS += -DUART_RX_BUFFER_SIZE=nn to your Makefile.
+ *  Up to 256 bytes the buffer indices are 8 bit. Larger buffers, e.g. 1024
+ *  bytes on ATmega2560, use 16 bit indices accessed with interrupts disabled.
  */
 #ifndef UART_RX_BUFFER_SIZE
 # define UART_RX_BUFFER_SIZE 32
@@ -88,16 +146,59 @@
  *
  *  You may need to adapt this constant to your target and your application by adding
  *  CDEFS += -DUART_TX_BUFFER_SIZE=nn to your Makefile.
+ *  Up to 256 bytes the buffer indices are 8 bit. Larger buffers, e.g. 1024
+ *  bytes on ATmega2560, use 16 bit indices accessed with interrupts disabled.
  */
 #ifndef UART_TX_BUFFER_SIZE
 # define UART_TX_BUFFER_SIZE 32
 #endif
 
+/*
+** transmit buffer overflow policies
+*/
+#define UART_TX_BLOCK       0 /**< @brief wait for free space, deadlocks if interrupts are disabled */
+#define UART_TX_DROP_NEWEST 1 /**< @brief discard bytes which do not fit */
+#define UART_TX_DROP_OLDEST 2 /**< @brief discard oldest bytes in buffer to make space */
+#define UART_TX_TRUNCATE    3 /**< @brief discard bytes which do not fit, mark the gap by UART_TX_MARKER */
+
+/** @brief  Policy when the transmit buffer is full and the caller cannot wait
+ *
+ *  With interrupts enabled, uart_putc() and uart_puts() wait until the
+ *  UDRE interrupt frees space in the buffer. Inside an interrupt routine
+ *  the interrupt cannot run, so the policy is applied instead and the
+ *  call returns in bounded time. uart_puts_nb() applies the policy always.
+ *  UART_TX_BLOCK keeps the original behaviour of waiting in all cases.
+ */
+#ifndef UART_TX_OVERFLOW_POLICY
+# define UART_TX_OVERFLOW_POLICY UART_TX_TRUNCATE
+#endif
+
+/** @brief  Character sent in place of discarded bytes with policy UART_TX_TRUNCATE */
+#ifndef UART_TX_MARKER
+# define UART_TX_MARKER '~'
+#endif
+
 /* test if the size of the circular buffers fits into SRAM */
 #if ( (UART_RX_BUFFER_SIZE + UART_TX_BUFFER_SIZE) >= (RAMEND - 0x60 ) )
 # error "size of UART_RX_BUFFER_SIZE + UART_TX_BUFFER_SIZE larger than size of SRAM"
 #endif
 
+/** @brief  Free space in transmit ringbuffer, see uart_tx_reserve()
+ *
+ *  The space wraps around the end of the ringbuffer, so it consists of
+ *  two contiguous runs. The second run is empty if the space does not wrap.
+ */
+typedef struct {
+    unsigned char *p1;  /**< @brief first run */
+    unsigned int   n1;  /**< @brief length of first run */
+    unsigned char *p2;  /**< @brief second run, at the beginning of the ringbuffer */
+    unsigned int   n2;  /**< @brief length of second run */
+} uart_span_t;
+
+/** @brief  Pointer to i-th byte of reserved space */
+#define UART_SPAN_AT(span, i) \
+    ((i) < (span)->n1 ? &(span)->p1[i] : &(span)->p2[(i) - (span)->n1])
+
 /*
 ** high byte error return code of uart_getc()
 */
@@ -120,6 +221,17 @@
 extern void uart_init(unsigned int baudrate);
 
 
+/**
+ * @brief   Change baudrate without resetting the ringbuffers
+ *
+ * Waits until all buffered data has left the transmitter, so it must be
+ * called with interrupts enabled. Received data is kept.
+ * @param   baudrate Specify baudrate using macro UART_BAUD_SELECT_AUTO()
+ * @return  none
+ */
+extern void uart_set_baudrate(unsigned int baudrate);
+
+
 /**
  *  @brief   Get received byte from ringbuffer
  *
@@ -149,10 +261,14 @@ extern unsigned int uart_getc(void);
 
 /**
  *  @brief   Put byte to ringbuffer for transmitting via UART
+ *
+ *  Waits for free space if interrupts are enabled, otherwise the byte
+ *  is handled by UART_TX_OVERFLOW_POLICY.
+ *
  *  @param   data byte to be transmitted
- *  @return  none
+ *  @return  1 if the byte was stored, 0 if it was discarded
  */
-extern void uart_putc(unsigned char data);
+extern unsigned char uart_putc(unsigned char data);
 
 
 /**
@@ -160,12 +276,68 @@ extern void uart_putc(unsigned char data);
  *
  *  The string is buffered by the uart library in a circular buffer
  *  and one character at a time is transmitted to the UART using interrupts.
- *  Blocks if it can not write the whole string into the circular buffer.
+ *  Blocks if it can not write the whole string into the circular buffer
+ *  and interrupts are enabled, otherwise UART_TX_OVERFLOW_POLICY is applied.
+ *
+ *  @param   s string to be transmitted
+ *  @return  number of characters stored in the circular buffer
+ */
+extern unsigned int uart_puts(const char *s);
+
+
+/**
+ *  @brief   Put string to ringbuffer without waiting for free space
+ *
+ *  Characters which do not fit are handled by UART_TX_OVERFLOW_POLICY,
+ *  UART_TX_BLOCK discards them like UART_TX_DROP_NEWEST.
  *
  *  @param   s string to be transmitted
+ *  @return  number of characters stored in the circular buffer
+ */
+extern unsigned int uart_puts_nb(const char *s);
+
+
+/**
+ *  @brief   Put block of bytes to ringbuffer for transmitting via UART
+ *
+ *  Bytes are copied in at most two contiguous runs and published to the
+ *  transmit interrupt at once. Blocks if it can not write the whole block
+ *  and interrupts are enabled, otherwise UART_TX_OVERFLOW_POLICY is applied.
+ *
+ *  @param   buf bytes to be transmitted
+ *  @param   len number of bytes
+ *  @return  number of bytes stored in the circular buffer
+ */
+extern unsigned int uart_write(const unsigned char *buf, unsigned int len);
+
+
+/**
+ *  @brief   Reserve free space in transmit ringbuffer for direct writing
+ *
+ *  The caller writes bytes directly into the reserved space, for example
+ *  by UART_SPAN_AT(), and publishes them by uart_tx_commit(). Other bytes
+ *  must not be put to the ringbuffer between reserve and commit.
+ *
+ *  @param   span reserved space
+ *  @param   len requested number of bytes
+ *  @return  number of bytes reserved, less than len if there is not enough space
+ */
+extern unsigned int uart_tx_reserve(uart_span_t *span, unsigned int len);
+
+
+/**
+ *  @brief   Publish bytes written into space reserved by uart_tx_reserve()
+ *  @param   len number of bytes written, at most the reserved number
  *  @return  none
  */
-extern void uart_puts(const char *s);
+extern void uart_tx_commit(unsigned int len);
+
+
+/**
+ *  @brief   Get number of bytes discarded because of full transmit buffer
+ *  @return  number of discarded bytes since uart_init(), saturates at 65535
+ */
+extern unsigned int uart_tx_overflows(void);
 
 
 /**
@@ -173,13 +345,14 @@ extern void uart_puts(const char *s);
  *
  * The string is buffered by the uart library in a circular buffer
  * and one character at a time is transmitted to the UART using interrupts.
- * Blocks if it can not write the whole string into the circular buffer.
+ * Blocks if it can not write the whole string into the circular buffer
+ * and interrupts are enabled, otherwise UART_TX_OVERFLOW_POLICY is applied.
  *
  * @param    s program memory string to be transmitted
- * @return   none
+ * @return   number of characters stored in the circular buffer
  * @see      uart_puts_P
  */
-extern void uart_puts_p(const char *s);
+extern unsigned int uart_puts_p(const char *s);
 
 /**
  * @brief    Macro to automatically put a string constant into program memory